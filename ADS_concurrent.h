@@ -0,0 +1,326 @@
+#ifndef ADS_CONCURRENT_H
+#define ADS_CONCURRENT_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "ADS_hashers.h"
+
+// Pieces shared by the thread-safe sets that run their own directory
+// instead of wrapping ADS_set.
+
+//////////   HASHING   //////////
+// The user's hasher followed by a mix: fmix64 over the raw hash xor-ed
+// with a seed, because std::hash for integers is the identity and strided
+// keys would share their low bits. Hashers declaring
+// `using is_avalanching = void;` are used as they are. These sets cannot
+// rehash everything later, so the seed is drawn once, at construction.
+template <typename Hash> class MixedHash {
+  template <typename H, typename = void>
+  struct avalanching : std::false_type {};
+  template <typename H>
+  struct avalanching<H, std::void_t<typename H::is_avalanching>>
+      : std::true_type {};
+  Hash hash;
+  std::uint64_t seed{0};
+
+public:
+  explicit MixedHash(const Hash &hash) : hash(hash) {
+    if (avalanching<Hash>::value)
+      return;
+    auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+    seed = ads_hash::fmix64(static_cast<std::uint64_t>(now) ^
+                            reinterpret_cast<std::uintptr_t>(this)) |
+           1;
+  }
+  const Hash &function() const { return hash; }
+  template <typename K> size_t operator()(const K &key) const {
+    std::uint64_t raw = static_cast<std::uint64_t>(hash(key));
+    if (avalanching<Hash>::value)
+      return static_cast<size_t>(raw);
+    return static_cast<size_t>(ads_hash::fmix64(raw ^ seed));
+  }
+};
+
+//////////   BUCKETS & TABLES   //////////
+// Allocates buckets, constructed from their local depth, and directories of
+// 2^global_depth atomic bucket pointers. Slots are indexed by the low hash
+// bits, so a bucket of local depth d sits at every 2^d-th slot.
+template <typename Bucket, typename Allocator> class BucketTables {
+public:
+  using size_type = size_t;
+  using Slot = std::atomic<Bucket *>;
+  struct Table {
+    size_type global_depth;
+    Slot *slots;
+  };
+
+  explicit BucketTables(const Allocator &a)
+      : bucket_alloc(a), slot_alloc(a), table_alloc(a) {}
+  BucketTables(const BucketTables &) = delete;
+  BucketTables &operator=(const BucketTables &) = delete;
+
+  Bucket *make_bucket(size_type depth) {
+    Bucket *bucket = bucket_traits::allocate(bucket_alloc, 1);
+    try {
+      bucket_traits::construct(bucket_alloc, bucket, depth);
+    } catch (...) {
+      bucket_traits::deallocate(bucket_alloc, bucket, 1);
+      throw;
+    }
+    return bucket;
+  }
+  void drop_bucket(Bucket *bucket) {
+    bucket_traits::destroy(bucket_alloc, bucket);
+    bucket_traits::deallocate(bucket_alloc, bucket, 1);
+  }
+  // every slot null
+  Table *make_table(size_type depth) {
+    size_type size = size_type{1} << depth;
+    Table *table = table_traits::allocate(table_alloc, 1);
+    try {
+      table->slots = slot_traits::allocate(slot_alloc, size);
+    } catch (...) {
+      table_traits::deallocate(table_alloc, table, 1);
+      throw;
+    }
+    table->global_depth = depth;
+    for (size_type i{0}; i < size; ++i)
+      slot_traits::construct(slot_alloc, table->slots + i, nullptr);
+    return table;
+  }
+  void drop_table(Table *table) {
+    size_type size = size_type{1} << table->global_depth;
+    for (size_type i{0}; i < size; ++i)
+      slot_traits::destroy(slot_alloc, table->slots + i);
+    slot_traits::deallocate(slot_alloc, table->slots, size);
+    table_traits::deallocate(table_alloc, table, 1);
+  }
+  // a fresh depth 1 directory with two empty buckets
+  Table *make_root() {
+    Table *table = make_table(1);
+    try {
+      table->slots[0].store(make_bucket(1), std::memory_order_relaxed);
+      table->slots[1].store(make_bucket(1), std::memory_order_relaxed);
+    } catch (...) {
+      if (Bucket *bucket = table->slots[0].load(std::memory_order_relaxed))
+        drop_bucket(bucket);
+      drop_table(table);
+      throw;
+    }
+    return table;
+  }
+  // A bucket's lowest alias is the only slot below 2^local_depth; walking
+  // down reaches it after every other alias, so f may free the bucket.
+  template <typename F> static void each_bucket(const Table *table, F f) {
+    for (size_type i = size_type{1} << table->global_depth; i-- > 0;) {
+      Bucket *bucket = table->slots[i].load(std::memory_order_relaxed);
+      if (i < (size_type{1} << bucket->local_depth))
+        f(bucket);
+    }
+  }
+  // table and every bucket in it
+  void drop_all(Table *table) {
+    each_bucket(table, [this](Bucket *bucket) { drop_bucket(bucket); });
+    drop_table(table);
+  }
+
+private:
+  template <typename T>
+  using rebind =
+      typename std::allocator_traits<Allocator>::template rebind_alloc<T>;
+  using bucket_traits = std::allocator_traits<rebind<Bucket>>;
+  using slot_traits = std::allocator_traits<rebind<Slot>>;
+  using table_traits = std::allocator_traits<rebind<Table>>;
+  rebind<Bucket> bucket_alloc;
+  rebind<Slot> slot_alloc;
+  rebind<Table> table_alloc;
+};
+
+//////////   EPOCHS   //////////
+// Epoch-based reclamation. A reader announces the epoch it started in for
+// the length of one lookup; a writer frees what it retired once every
+// announcement has moved two epochs past it.
+//
+// Every domain shares one epoch counter and one list of reader records. A
+// thread registers a record on its first read and holds it until it exits,
+// so a read is two stores to the thread's own cache line, wait-free however
+// many threads read. Registering takes over a record an exited thread left,
+// or appends one with a CAS that may retry; records are never freed.
+//
+// Announcements, the readers' loads of shared pointers, the writer's
+// unlinking stores and the writer's scan in advance() are all seq_cst: if
+// the scan misses an announcement, that reader's loads come later in the
+// total order and see the unlinked state.
+class EpochDomain {
+  struct alignas(64) Reader {
+    std::atomic<std::uint64_t> epoch{0}; // 0 while not reading
+    std::atomic<bool> taken{true};
+    Reader *next{nullptr};
+    size_t depth{0}; // guards the owning thread has open
+  };
+  class Registration {
+    Reader *record;
+
+  public:
+    Registration() : record(claim()) {}
+    Registration(const Registration &) = delete;
+    Registration &operator=(const Registration &) = delete;
+    ~Registration() { record->taken.store(false, std::memory_order_release); }
+    Reader &reader() const { return *record; }
+  };
+  static std::atomic<Reader *> &readers() {
+    static std::atomic<Reader *> head{nullptr};
+    return head;
+  }
+  static std::atomic<std::uint64_t> &global() {
+    static std::atomic<std::uint64_t> epoch{1};
+    return epoch;
+  }
+  static Reader &local() {
+    thread_local Registration registration;
+    return registration.reader();
+  }
+  static Reader *claim() {
+    std::atomic<Reader *> &head = readers();
+    for (Reader *reader = head.load(std::memory_order_acquire); reader;
+         reader = reader->next) {
+      bool expected = false;
+      if (reader->taken.compare_exchange_strong(expected, true,
+                                                std::memory_order_acquire))
+        return reader;
+    }
+    Reader *reader = new Reader;
+    reader->next = head.load(std::memory_order_relaxed);
+    while (!head.compare_exchange_weak(reader->next, reader,
+                                       std::memory_order_release,
+                                       std::memory_order_relaxed))
+      ;
+    return reader;
+  }
+
+public:
+  // Guards nest, the outermost one announces.
+  class ReadGuard {
+    Reader &reader;
+
+  public:
+    explicit ReadGuard(const EpochDomain &) : reader(local()) {
+      if (reader.depth++ == 0)
+        reader.epoch.store(global().load(std::memory_order_seq_cst),
+                           std::memory_order_seq_cst);
+    }
+    ReadGuard(const ReadGuard &) = delete;
+    ReadGuard &operator=(const ReadGuard &) = delete;
+    ~ReadGuard() {
+      if (--reader.depth == 0)
+        reader.epoch.store(0, std::memory_order_release);
+    }
+  };
+  // tag for what the writer retires now
+  std::uint64_t epoch() const {
+    return global().load(std::memory_order_acquire);
+  }
+  // Moves to the next epoch once every active reader has seen the current
+  // one. A reader in epoch e may hold anything retired in e - 1 or later.
+  bool advance() {
+    std::uint64_t epoch = global().load(std::memory_order_seq_cst);
+    for (Reader *reader = readers().load(std::memory_order_acquire); reader;
+         reader = reader->next) {
+      std::uint64_t seen = reader->epoch.load(std::memory_order_seq_cst);
+      if (seen != 0 && seen != epoch)
+        return false;
+    }
+    // failing means another domain advanced it, which is as good
+    global().compare_exchange_strong(epoch, epoch + 1,
+                                     std::memory_order_seq_cst);
+    return true;
+  }
+  // no reader can still reach what was retired two epochs back
+  bool expired(std::uint64_t retired_at) const {
+    return retired_at + 2 <= epoch();
+  }
+};
+
+//////////   RETIRING   //////////
+// BucketTables whose buckets and directories readers may still hold after
+// the writer unlinked them. They are retired instead of dropped and freed
+// through an EpochDomain; whatever is left goes with the object. All of it
+// runs under the owning set's writer lock.
+template <typename Bucket, typename Allocator>
+class EpochTables : public BucketTables<Bucket, Allocator> {
+  using Base = BucketTables<Bucket, Allocator>;
+  template <typename T>
+  using rebind =
+      typename std::allocator_traits<Allocator>::template rebind_alloc<T>;
+  template <typename T> using retired = std::pair<std::uint64_t, T *>;
+
+public:
+  using typename Base::size_type;
+  using typename Base::Table;
+
+  explicit EpochTables(const Allocator &a)
+      : Base(a), retired_buckets(rebind<retired<Bucket>>(a)),
+        retired_tables(rebind<retired<Table>>(a)) {}
+  ~EpochTables() {
+    for (const retired<Bucket> &entry : retired_buckets)
+      this->drop_bucket(entry.second);
+    for (const retired<Table> &entry : retired_tables)
+      this->drop_table(entry.second);
+  }
+  const EpochDomain &domain() const { return epochs; }
+  // room to retire that many more without allocating, so a writer can
+  // reserve before it unlinks and retire after without throwing
+  void reserve(size_type buckets, size_type tables) {
+    retired_buckets.reserve(retired_buckets.size() + buckets);
+    retired_tables.reserve(retired_tables.size() + tables);
+  }
+  void retire(Bucket *bucket) {
+    retired_buckets.emplace_back(epochs.epoch(), bucket);
+    if (retired_buckets.size() >= 64)
+      reclaim();
+  }
+  void retire(Table *table) {
+    retired_tables.emplace_back(epochs.epoch(), table);
+    reclaim();
+  }
+  // table and every bucket in it
+  void retire_all(Table *table) {
+    Base::each_bucket(table, [this](Bucket *bucket) { retire(bucket); });
+    retire(table);
+  }
+  void reclaim() {
+    if (!epochs.advance())
+      return;
+    auto expired = [this](const auto &entry) {
+      return epochs.expired(entry.first);
+    };
+    for (const retired<Bucket> &entry : retired_buckets) {
+      if (expired(entry))
+        this->drop_bucket(entry.second);
+    }
+    retired_buckets.erase(std::remove_if(retired_buckets.begin(),
+                                         retired_buckets.end(), expired),
+                          retired_buckets.end());
+    for (const retired<Table> &entry : retired_tables) {
+      if (expired(entry))
+        this->drop_table(entry.second);
+    }
+    retired_tables.erase(std::remove_if(retired_tables.begin(),
+                                        retired_tables.end(), expired),
+                         retired_tables.end());
+  }
+
+private:
+  EpochDomain epochs;
+  std::vector<retired<Bucket>, rebind<retired<Bucket>>> retired_buckets;
+  std::vector<retired<Table>, rebind<retired<Table>>> retired_tables;
+};
+
+#endif // ADS_CONCURRENT_H
@@ -0,0 +1,152 @@
+#ifndef ADS_HASHERS_H
+#define ADS_HASHERS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+// Hashers for the Hash parameter of ADS_set. The directory is indexed by the
+// low bits of the hash, or the high ones under ADS_SET_MSB_INDEX, and
+// libstdc++'s std::hash for integers is the identity, so each of these
+// spreads every key bit over the whole result.
+// They take integral keys and anything convertible to std::string_view, and
+// carry a seed, so ADS_set stores them, e.g.
+//
+//   ADS_set<std::uint64_t, 63, std::allocator<std::uint64_t>, WyHash>
+//       set(0, WyHash(seed));
+//
+// A std::string hashes like a std::string_view of its bytes, so all three
+// are transparent: with std::equal_to<> as KeyEqual, a string set can be
+// searched by string_view.
+
+namespace ads_hash {
+inline std::uint64_t fmix64(std::uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdull;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ull;
+  x ^= x >> 33;
+  return x;
+}
+// both halves of the 128-bit product folded together
+inline std::uint64_t mum(std::uint64_t a, std::uint64_t b) {
+  __extension__ using wide = unsigned __int128;
+  wide product = static_cast<wide>(a) * b;
+  return static_cast<std::uint64_t>(product) ^
+         static_cast<std::uint64_t>(product >> 64);
+}
+inline std::uint64_t read64(const char *p) {
+  std::uint64_t word;
+  std::memcpy(&word, p, sizeof(word));
+  return word;
+}
+// the last 1..7 bytes, zero padded
+inline std::uint64_t read_tail(const char *p, std::size_t n) {
+  std::uint64_t word = 0;
+  std::memcpy(&word, p, n);
+  return word;
+}
+template <typename K>
+using if_integral = std::enable_if_t<std::is_integral<K>::value, int>;
+} // namespace ads_hash
+
+// MurmurHash3's 64-bit finalizer: two multiplies, no table, the cheapest of
+// the three for integers. Strings run it once per 8-byte word.
+struct FmixHash {
+  using is_avalanching = void; // ADS_set need not mix again
+  using is_transparent = void;
+  std::uint64_t seed;
+  explicit FmixHash(std::uint64_t seed = 0) : seed(seed) {}
+  template <typename K, ads_hash::if_integral<K> = 0>
+  std::size_t operator()(K key) const {
+    return static_cast<std::size_t>(
+        ads_hash::fmix64(static_cast<std::uint64_t>(key) ^ seed));
+  }
+  std::size_t operator()(std::string_view bytes) const {
+    const char *p = bytes.data();
+    std::size_t n = bytes.size();
+    std::uint64_t h = seed ^ (n * 0x9E3779B97F4A7C15ull);
+    for (; n >= 8; n -= 8, p += 8)
+      h = ads_hash::fmix64(h ^ ads_hash::read64(p)) * 0x9E3779B97F4A7C15ull;
+    if (n)
+      h ^= ads_hash::read_tail(p, n);
+    return static_cast<std::size_t>(ads_hash::fmix64(h));
+  }
+};
+
+// wyhash-style: one 64x64->128 multiply per 16 bytes. Not bit-compatible
+// with the reference wyhash.
+struct WyHash {
+  static constexpr std::uint64_t p0 = 0xa0761d6478bd642full;
+  static constexpr std::uint64_t p1 = 0xe7037ed1a0b428dbull;
+  static constexpr std::uint64_t p2 = 0x8ebc6af09c88c6e3ull;
+  using is_avalanching = void;
+  using is_transparent = void;
+  std::uint64_t seed;
+  explicit WyHash(std::uint64_t seed = 0) : seed(seed) {}
+  template <typename K, ads_hash::if_integral<K> = 0>
+  std::size_t operator()(K key) const {
+    return static_cast<std::size_t>(
+        ads_hash::mum(static_cast<std::uint64_t>(key) ^ p0, seed ^ p1));
+  }
+  std::size_t operator()(std::string_view bytes) const {
+    const char *p = bytes.data();
+    std::size_t n = bytes.size();
+    std::uint64_t h = seed ^ p0;
+    for (; n > 16; n -= 16, p += 16)
+      h = ads_hash::mum(ads_hash::read64(p) ^ p1, ads_hash::read64(p + 8) ^ h);
+    std::uint64_t a = 0, b = 0;
+    if (n > 8) {
+      a = ads_hash::read64(p);
+      b = ads_hash::read_tail(p + 8, n - 8);
+    } else if (n) {
+      a = ads_hash::read_tail(p, n);
+    }
+    return static_cast<std::size_t>(ads_hash::mum(
+        ads_hash::mum(a ^ p1, b ^ h) ^ p2, bytes.size() ^ p1));
+  }
+};
+
+// CRC32-C through the SSE4.2 instruction, one round per 8 bytes and one more
+// for the upper 32 bits. CRC is linear in the key bits, which spreads strided
+// integers evenly but is no defence against chosen keys. Builds without
+// SSE4.2 fall back to FmixHash.
+struct Crc32Hash {
+  using is_transparent = void;
+  std::uint64_t seed;
+  explicit Crc32Hash(std::uint64_t seed = 0) : seed(seed) {}
+  template <typename K, ads_hash::if_integral<K> = 0>
+  std::size_t operator()(K key) const {
+    std::uint64_t word = static_cast<std::uint64_t>(key);
+#if defined(__SSE4_2__)
+    std::uint64_t low = _mm_crc32_u64(seed, word);
+    std::uint64_t high = _mm_crc32_u64(low, word);
+    return static_cast<std::size_t>(low | high << 32);
+#else
+    return FmixHash(seed)(word);
+#endif
+  }
+  std::size_t operator()(std::string_view bytes) const {
+#if defined(__SSE4_2__)
+    const char *p = bytes.data();
+    std::size_t n = bytes.size();
+    std::uint64_t low = seed;
+    for (; n >= 8; n -= 8, p += 8)
+      low = _mm_crc32_u64(low, ads_hash::read64(p));
+    // the length goes in with the tail, so zero padding cannot collide
+    std::uint64_t tail = (n ? ads_hash::read_tail(p, n) : 0) ^ bytes.size();
+    low = _mm_crc32_u64(low, tail);
+    std::uint64_t high = _mm_crc32_u64(low, tail);
+    return static_cast<std::size_t>(low | high << 32);
+#else
+    return FmixHash(seed)(bytes);
+#endif
+  }
+};
+
+#endif // ADS_HASHERS_H
@@ -2,11 +2,83 @@
 #define ADS_SET_H
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
 #include <functional>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <new>
 #include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#ifdef __cpp_impl_coroutine
+#include <coroutine>
+#endif
 
-template <typename Key, size_t N = 63> class ADS_set {
+// Buckets keep a 1-byte fingerprint per slot so probes only run key_equal on
+// slots whose tag matches. Compile with -DADS_SET_FINGERPRINTS=0 to scan keys
+// directly, or -DADS_SET_NO_SIMD to use the scalar tag loop.
+#ifndef ADS_SET_FINGERPRINTS
+#define ADS_SET_FINGERPRINTS 1
+#endif
+#if ADS_SET_FINGERPRINTS && !defined(ADS_SET_NO_SIMD)
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define ADS_SET_TAG_BLOCK 32
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define ADS_SET_TAG_BLOCK 16
+#endif
+#endif
+// -DADS_SET_CACHE_HASH=1 stores every element's full hash next to it, so
+// split_bucket never calls the hasher again and probes compare hashes before
+// running key_equal. Costs sizeof(size_t) per slot.
+#ifndef ADS_SET_CACHE_HASH
+#define ADS_SET_CACHE_HASH 0
+#endif
+// Hashes go through murmur3's fmix64 finalizer before indexing, because
+// std::hash for integers is the identity and strided keys would share their
+// low bits. Hashers declaring `using is_avalanching = void;` skip it until a
+// reseed; -DADS_SET_MIX_HASH=0 indexes by the raw hash and never reseeds.
+#ifndef ADS_SET_MIX_HASH
+#define ADS_SET_MIX_HASH 1
+#endif
+// Below this bucket size sets index by the raw hash as if ADS_SET_MIX_HASH
+// were 0. A uniform hash grows the directory like n^(1 + 1/N) slots, about
+// n^2 at N = 1 and n^1.5 at N = 2, while dense integer keys under std::hash
+// need only ~n / N. No such fallback exists under ADS_SET_MSB_INDEX, which
+// therefore refuses N below this size.
+#ifndef ADS_SET_MIX_MIN_SIZE
+#define ADS_SET_MIX_MIN_SIZE 4
+#endif
+// -DADS_SET_MSB_INDEX=1 indexes the directory by the top global_depth hash
+// bits instead of the low ones. A bucket's aliases are then one run of slots,
+// and iterators visit buckets in hash-prefix order. The top bits of a raw
+// std::hash are mostly zero, so sets in this mode must mix or use a hasher
+// declaring is_avalanching, and N must be at least ADS_SET_MIX_MIN_SIZE;
+// ADS_set rejects other instantiations at compile time.
+#ifndef ADS_SET_MSB_INDEX
+#define ADS_SET_MSB_INDEX 0
+#endif
+// Threads used to bulk load random-access ranges into an empty set. The
+// default 1 keeps every insert on the calling thread; 0 means
+// std::thread::hardware_concurrency(). A parallel load calls the hasher, the
+// key's copy constructor and copies of the allocator from several threads at
+// once, so all three must be safe to call concurrently.
+#ifndef ADS_SET_BULK_THREADS
+#define ADS_SET_BULK_THREADS 1
+#endif
+
+template <typename Key, size_t N = 63, typename Allocator = std::allocator<Key>,
+          typename Hash = std::hash<Key>,
+          typename KeyEqual = std::equal_to<Key>>
+class ADS_set {
 public:
   class Iterator;
   using value_type = Key;
@@ -17,111 +89,1242 @@ public:
   using difference_type = std::ptrdiff_t;
   using const_iterator = Iterator;
   using iterator = const_iterator;
-  using key_equal = std::equal_to<key_type>;
-  using hasher = std::hash<key_type>;
+  using key_equal = KeyEqual;
+  using hasher = Hash;
+  using allocator_type = Allocator;
 
 private:
+  //////////   FINGERPRINTS   //////////
+#ifdef ADS_SET_TAG_BLOCK
+  static constexpr size_type tag_block = ADS_SET_TAG_BLOCK;
+#else
+  static constexpr size_type tag_block = 8;
+#endif
+  static constexpr size_type tag_slots =
+      (N + tag_block - 1) / tag_block * tag_block;
+  // top byte of a multiplicative mix, so identity hashes still spread
+  static std::uint8_t tag_of(size_type hash) {
+    return static_cast<std::uint8_t>(
+        (static_cast<std::uint64_t>(hash) * 0x9E3779B97F4A7C15ull) >> 56);
+  }
+#ifdef ADS_SET_TAG_BLOCK
+  // bit i set where tags[i] == tag, for one block of tag_block slots
+  static std::uint32_t match_tags(const std::uint8_t *tags, std::uint8_t tag) {
+#if ADS_SET_TAG_BLOCK == 32
+    __m256i block =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(tags));
+    __m256i hits =
+        _mm256_cmpeq_epi8(block, _mm256_set1_epi8(static_cast<char>(tag)));
+    return static_cast<std::uint32_t>(_mm256_movemask_epi8(hits));
+#else
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(tags));
+    __m128i hits = _mm_cmpeq_epi8(block, _mm_set1_epi8(static_cast<char>(tag)));
+    return static_cast<std::uint32_t>(_mm_movemask_epi8(hits));
+#endif
+  }
+#endif
+  //////////   HASH & KEY_EQUAL   //////////
+  // Held as base classes of Directory, so empty ones take no space.
+  template <typename F, int Tag,
+            bool = std::is_empty<F>::value && !std::is_final<F>::value>
+  struct Held : F {
+    explicit Held(const F &f) : F(f) {}
+    const F &held() const { return *this; }
+  };
+  template <typename F, int Tag> struct Held<F, Tag, false> {
+    F function;
+    explicit Held(const F &f) : function(f) {}
+    const F &held() const { return function; }
+  };
+  using HeldHash = Held<hasher, 0>;
+  using HeldEqual = Held<key_equal, 1>;
+  template <typename H, typename = void>
+  struct avalanching : std::false_type {};
+  template <typename H>
+  struct avalanching<H, std::void_t<typename H::is_avalanching>>
+      : std::true_type {};
+  template <typename H, typename E, typename = void>
+  struct transparent : std::false_type {};
+  template <typename H, typename E>
+  struct transparent<H, E,
+                     std::void_t<typename H::is_transparent,
+                                 typename E::is_transparent>>
+      : std::true_type {};
+  // enables the lookups taking other key types than key_type
+  template <typename K>
+  using if_transparent =
+      std::enable_if_t<transparent<hasher, key_equal>::value &&
+                           !std::is_same<K, key_type>::value,
+                       int>;
+  // whether this N mixes and reseeds at all, see ADS_SET_MIX_MIN_SIZE
+  static constexpr bool mixing = ADS_SET_MIX_HASH && N >= ADS_SET_MIX_MIN_SIZE;
+  static_assert(!ADS_SET_MSB_INDEX ||
+                    ((ADS_SET_MIX_HASH || avalanching<hasher>::value) &&
+                     N >= ADS_SET_MIX_MIN_SIZE),
+                "ADS_SET_MSB_INDEX needs N >= ADS_SET_MIX_MIN_SIZE and mixed "
+                "or avalanching hashes, or the directory outgrows memory");
+  static size_type mix(size_type hash) {
+    std::uint64_t x = static_cast<std::uint64_t>(hash);
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return static_cast<size_type>(x);
+  }
   //////////   BUCKET   //////////
-  struct Bucket {
+  // Header and slots share one cache-line aligned allocation, so a probe
+  // goes directory -> bucket without a second dependent load for elements.
+  struct alignas(64) Bucket {
+    static constexpr size_type size = N;
     size_type local_depth;
-    size_type size;
     size_type count{0};
-    key_type *elements;
-    Bucket(size_type depth) : local_depth(depth), size(N), count(0) {
-      elements = new key_type[N];
-    }
-    ~Bucket() { delete[] elements; }
+    size_type position{0}; // index in Directory::list
+    // directories listing this bucket; more than one after a snapshot, and
+    // then nobody writes to it, see Directory::own_bucket
+    std::atomic<size_type> owners{1};
+#if ADS_SET_FINGERPRINTS
+    std::uint8_t tags[tag_slots]{};
+#endif
+#if ADS_SET_CACHE_HASH
+    size_type hashes[N];
+#endif
+    key_type elements[N];
+    Bucket(size_type depth) : local_depth(depth), count(0) {}
     Bucket(const Bucket &other)
-        : local_depth(other.local_depth), size(N), count(other.count) {
-      elements = new key_type[N];
-      for (size_t i{0}; i < count; ++i)
-        elements[i] = other.elements[i];
+        : local_depth(other.local_depth), count(other.count),
+          position(other.position) {
+#if ADS_SET_FINGERPRINTS
+      std::copy(other.tags, other.tags + count, tags);
+#endif
+#if ADS_SET_CACHE_HASH
+      std::copy(other.hashes, other.hashes + count, hashes);
+#endif
+      std::copy(other.elements, other.elements + count, elements);
     }
     Bucket &operator=(const Bucket &other) {
       if (this != &other) {
         local_depth = other.local_depth;
-        size = N;
         count = other.count;
-        delete[] elements;
-        elements = new key_type[N];
         for (size_t i{0}; i < count; ++i)
-          elements[i] = other.elements[i];
+          copy_slot(i, other, i);
       }
       return *this;
     }
     inline bool split() const { return count >= (1 * size);}
     inline bool isFull() const { return count >= (size); }
-    void insert(const key_type &key) { elements[count++] = key; }
+    template <typename K> void insert(K &&key, size_type hash) {
+#if ADS_SET_FINGERPRINTS
+      tags[count] = tag_of(hash);
+#endif
+#if ADS_SET_CACHE_HASH
+      hashes[count] = hash;
+#else
+      (void)hash;
+#endif
+      elements[count++] = std::forward<K>(key);
+    }
+    void copy_slot(size_type to, const Bucket &from, size_type at) {
+      copy_meta(to, from, at);
+      elements[to] = from.elements[at];
+    }
+    // from and at must not name slot `to` itself
+    void move_slot(size_type to, Bucket &from, size_type at) {
+      copy_meta(to, from, at);
+      elements[to] = std::move(from.elements[at]);
+    }
+    // moves the elements whose hash has `bit` set into `into`
+    template <typename Hashing>
+    void divide(Bucket &into, size_type bit, const Hashing &hashing) {
+      size_type old_count = count;
+      count = 0;
+      for (size_type i = 0; i < old_count; ++i) {
+#if ADS_SET_CACHE_HASH
+        size_type hash = hashes[i];
+        (void)hashing;
+#else
+        size_type hash = hashing.hash(elements[i]);
+#endif
+        if ((hash & bit) == 0) {
+          if (count != i)
+            move_slot(count, *this, i);
+          ++count;
+        } else {
+          into.insert(std::move(elements[i]), hash);
+        }
+      }
+    }
+    void copy_meta(size_type to, const Bucket &from, size_type at) {
+#if ADS_SET_FINGERPRINTS
+      tags[to] = from.tags[at];
+#endif
+#if ADS_SET_CACHE_HASH
+      hashes[to] = from.hashes[at];
+#endif
+      (void)to, (void)from, (void)at;
+    }
+    // cached hashes reject tag collisions before key_equal runs
+    template <typename K>
+    bool holds(size_type at, const K &key, size_type hash,
+               const key_equal &equal) const {
+#if ADS_SET_CACHE_HASH
+      if (hashes[at] != hash)
+        return false;
+#else
+      (void)hash;
+#endif
+      return equal(elements[at], key);
+    }
+    // slot holding key, or count if it is not in this bucket
+    template <typename K>
+    size_type locate(const K &key, size_type hash,
+                     const key_equal &equal) const {
+#if ADS_SET_FINGERPRINTS
+      std::uint8_t tag = tag_of(hash);
+#endif
+#if ADS_SET_FINGERPRINTS && defined(ADS_SET_TAG_BLOCK)
+      for (size_type base{0}; base < count; base += tag_block) {
+        std::uint32_t hits = match_tags(tags + base, tag);
+        if (count - base < tag_block)
+          hits &= (std::uint32_t{1} << (count - base)) - 1;
+        while (hits) {
+          size_type i = base + static_cast<size_type>(__builtin_ctz(hits));
+          if (holds(i, key, hash, equal))
+            return i;
+          hits &= hits - 1;
+        }
+      }
+#else
+      for (size_type i{0}; i < count; ++i) {
+#if ADS_SET_FINGERPRINTS
+        if (tags[i] != tag)
+          continue;
+#endif
+        if (holds(i, key, hash, equal))
+          return i;
+      }
+#endif
+      return count;
+    }
+    // header and tags (or the first slots) are what locate() touches first
+    void prefetch() const {
+      const char *line = reinterpret_cast<const char *>(this);
+      __builtin_prefetch(line);
+      __builtin_prefetch(line + 64);
+    }
+  };
+  // stands in for the table of a set that owns no buckets yet (default
+  // constructed or moved from), so lookups need no special case
+  static Bucket **empty_table() {
+    static Bucket empty(0);
+    static Bucket *table[1] = {&empty};
+    return table;
+  }
+  // the same empty bucket marks a hole in Directory::list
+  static Bucket *hole() { return empty_table()[0]; }
+  //////////   BUCKET POOL   //////////
+  // Buckets are carved out of slab pages and recycled through a free list,
+  // so splits and clear() stop calling the allocator once the pool is warm.
+  class BucketPool {
+    union Slot;
+    struct Page {
+      Slot *next;
+      size_type slots;
+      size_type idle; // its slots on the free list, counted by trim()
+    };
+    union Slot {
+      Slot *next;
+      Page page;
+      alignas(Bucket) unsigned char storage[sizeof(Bucket)];
+    };
+    using slot_allocator =
+        typename std::allocator_traits<Allocator>::template rebind_alloc<Slot>;
+    using slot_traits = std::allocator_traits<slot_allocator>;
+    // pages handed over at a snapshot, freed by the last pool holding them,
+    // since any pool sharing a bucket may end up releasing it
+    struct Kept {
+      std::atomic<size_type> owners;
+      Slot *pages;
+    };
+    using kept_allocator =
+        typename std::allocator_traits<Allocator>::template rebind_alloc<Kept>;
+    using kept_traits = std::allocator_traits<kept_allocator>;
+    using kept_list_allocator = typename std::allocator_traits<
+        Allocator>::template rebind_alloc<Kept *>;
+    // pages grow geometrically up to ~256KiB, slot 0 of a page is its header
+    static constexpr size_type max_page_slots =
+        sizeof(Slot) * 4 > (1 << 18) ? 4 : (1 << 18) / sizeof(Slot);
+
+    slot_allocator alloc;
+    Slot *pages{nullptr};
+    Slot *free_list{nullptr};
+    Slot *fresh{nullptr};
+    Slot *fresh_end{nullptr};
+    size_type next_page_slots{2};
+    size_type live{0}; // buckets handed out
+    size_type idle{0}; // slots on the free list
+    std::vector<Kept *, kept_list_allocator> kept;
+
+    void free_pages(Slot *page) {
+      while (page) {
+        Slot *next = page->page.next;
+        slot_traits::deallocate(alloc, page, page->page.slots + 1);
+        page = next;
+      }
+    }
+
+    static bool below(const Slot *a, const Slot *b) {
+      return std::less<const Slot *>()(a, b);
+    }
+    // bottom-up merge sort of a list linked through link(slot), in place
+    template <typename Link>
+    static Slot *sort_by_address(Slot *list, Link link) {
+      for (size_type run{1};; run <<= 1) {
+        Slot *head = nullptr;
+        Slot **tail = &head;
+        size_type merges{0};
+        for (Slot *p = list; p;) {
+          ++merges;
+          Slot *q = p;
+          size_type p_size{0}, q_size{run};
+          for (; q && p_size < run; ++p_size)
+            q = link(q);
+          while (p_size > 0 || (q_size > 0 && q)) {
+            Slot *next;
+            if (p_size == 0 || (q_size > 0 && q && below(q, p))) {
+              next = q;
+              q = link(q);
+              --q_size;
+            } else {
+              next = p;
+              p = link(p);
+              --p_size;
+            }
+            *tail = next;
+            tail = &link(next);
+          }
+          p = q;
+        }
+        *tail = nullptr;
+        list = head;
+        if (merges <= 1)
+          return list;
+      }
+    }
+
+    void grow() {
+      Slot *page = slot_traits::allocate(alloc, next_page_slots + 1);
+      page->page = Page{pages, next_page_slots, 0};
+      pages = page;
+      fresh = page + 1;
+      fresh_end = fresh + next_page_slots;
+      if (next_page_slots < max_page_slots)
+        next_page_slots <<= 1;
+    }
+
+  public:
+    explicit BucketPool(const Allocator &a)
+        : alloc(a), kept(kept_list_allocator(a)) {}
+    BucketPool(BucketPool &&other) noexcept
+        : alloc(std::move(other.alloc)), pages(other.pages),
+          free_list(other.free_list), fresh(other.fresh),
+          fresh_end(other.fresh_end), next_page_slots(other.next_page_slots),
+          live(other.live), idle(other.idle), kept(std::move(other.kept)) {
+      other.pages = other.free_list = other.fresh = other.fresh_end = nullptr;
+      other.next_page_slots = 2;
+      other.live = other.idle = 0;
+      other.kept.clear();
+    }
+    BucketPool(const BucketPool &) = delete;
+    BucketPool &operator=(const BucketPool &) = delete;
+    ~BucketPool() {
+      free_pages(pages);
+      kept_allocator kept_alloc(alloc);
+      for (Kept *pages_kept : kept) {
+        if (pages_kept->owners.fetch_sub(1, std::memory_order_acq_rel) != 1)
+          continue;
+        free_pages(pages_kept->pages);
+        kept_traits::destroy(kept_alloc, pages_kept);
+        kept_traits::deallocate(kept_alloc, pages_kept, 1);
+      }
+    }
+    // Every bucket so far may now be released by into as well, so all our
+    // pages move to a Kept both pools hold. New pages are ours alone again.
+    void share(BucketPool &into) {
+      if (pages) {
+        kept_allocator kept_alloc(alloc);
+        Kept *pages_kept = kept_traits::allocate(kept_alloc, 1);
+        try {
+          kept.push_back(pages_kept);
+        } catch (...) {
+          kept_traits::deallocate(kept_alloc, pages_kept, 1);
+          throw;
+        }
+        kept_traits::construct(kept_alloc, pages_kept);
+        pages_kept->owners.store(1, std::memory_order_relaxed);
+        pages_kept->pages = pages;
+        pages = nullptr;
+      }
+      into.kept.reserve(into.kept.size() + kept.size());
+      for (Kept *pages_kept : kept) {
+        pages_kept->owners.fetch_add(1, std::memory_order_relaxed);
+        into.kept.push_back(pages_kept);
+      }
+    }
+    // constructs the bucket in place from args, a depth or a bucket to copy
+    template <typename... Args> Bucket *acquire(Args &&...args) {
+      Slot *slot;
+      if (free_list) {
+        slot = free_list;
+        free_list = slot->next;
+        --idle;
+      } else {
+        if (fresh == fresh_end)
+          grow();
+        slot = fresh++;
+      }
+      try {
+        Bucket *bucket =
+            new (slot->storage) Bucket(std::forward<Args>(args)...);
+        ++live;
+        return bucket;
+      } catch (...) {
+        slot->next = free_list;
+        free_list = slot;
+        ++idle;
+        throw;
+      }
+    }
+    void release(Bucket *bucket) {
+      bucket->~Bucket();
+      Slot *slot = reinterpret_cast<Slot *>(bucket);
+      slot->next = free_list;
+      free_list = slot;
+      --live;
+      ++idle;
+    }
+    // worth trimming once more slots sit idle than hold buckets
+    bool mostly_idle() const { return idle > live; }
+    // hand pages whose slots are all on the free list back to the allocator;
+    // the newest page is kept since its uncarved tail is not on the list.
+    // Sorting both lists by address lets one walk count each page's free
+    // slots into its header, so trimming allocates nothing.
+    void trim() {
+      if (!pages)
+        return;
+      auto page_link = [](Slot *slot) -> Slot *& { return slot->page.next; };
+      auto free_link = [](Slot *slot) -> Slot *& { return slot->next; };
+      Slot *older = sort_by_address(pages->page.next, page_link);
+      free_list = sort_by_address(free_list, free_link);
+      bool any = false;
+      Slot *slot = free_list;
+      for (Slot *page = older; page; page = page->page.next) {
+        page->page.idle = 0;
+        while (slot && below(slot, page))
+          slot = slot->next; // on the newest page
+        for (; slot && !below(page + page->page.slots, slot);
+             slot = slot->next)
+          ++page->page.idle;
+        any = any || page->page.idle == page->page.slots;
+      }
+      pages->page.next = older;
+      if (!any)
+        return;
+      Slot **link = &free_list;
+      Slot *page = older;
+      while (*link) {
+        while (page && below(page + page->page.slots, *link))
+          page = page->page.next;
+        if (page && !below(*link, page) &&
+            page->page.idle == page->page.slots) {
+          *link = (*link)->next;
+          --idle;
+        } else {
+          link = &(*link)->next;
+        }
+      }
+      for (Slot *keep = pages; Slot *next = keep->page.next;) {
+        if (next->page.idle == next->page.slots) {
+          keep->page.next = next->page.next;
+          slot_traits::deallocate(alloc, next, next->page.slots + 1);
+        } else {
+          keep = next;
+        }
+      }
+    }
+    // take over other's pages and buckets; both pools' allocators are equal
+    void adopt(BucketPool &other) noexcept {
+      // other's uncarved slots go on its free list, so only our newest page
+      // keeps a fresh tail
+      while (other.fresh != other.fresh_end) {
+        Slot *slot = other.fresh++;
+        slot->next = other.free_list;
+        other.free_list = slot;
+        ++other.idle;
+      }
+      if (other.free_list) {
+        Slot *tail = other.free_list;
+        while (tail->next)
+          tail = tail->next;
+        tail->next = free_list;
+        free_list = other.free_list;
+      }
+      if (other.pages) {
+        Slot *tail = other.pages;
+        while (tail->page.next)
+          tail = tail->page.next;
+        if (pages) {
+          tail->page.next = pages->page.next;
+          pages->page.next = other.pages;
+        } else {
+          pages = other.pages;
+        }
+      }
+      live += other.live;
+      idle += other.idle;
+      other.pages = other.free_list = other.fresh = other.fresh_end = nullptr;
+      other.live = other.idle = 0;
+    }
+    void swap(BucketPool &other) {
+      using std::swap;
+      swap(alloc, other.alloc);
+      swap(pages, other.pages);
+      swap(free_list, other.free_list);
+      swap(fresh, other.fresh);
+      swap(fresh_end, other.fresh_end);
+      swap(next_page_slots, other.next_page_slots);
+      swap(live, other.live);
+      swap(idle, other.idle);
+      swap(kept, other.kept);
+    }
+    Allocator get_allocator() const { return Allocator(alloc); }
   };
+  //////////   LAYOUT   //////////
+  // Which hash bits pick a slot. A bucket of local depth d in a table of
+  // depth g has 2^(g - d) aliases: every 2^d-th slot when the low bits index,
+  // a run of adjacent slots when the high bits do.
+  static constexpr size_type hash_bits =
+      std::numeric_limits<size_type>::digits;
+  static size_type slot_of(size_type hash, size_type depth) {
+#if ADS_SET_MSB_INDEX
+    return hash >> 1 >> (hash_bits - 1 - depth); // depth 0 gives slot 0
+#else
+    return hash & ((size_type{1} << depth) - 1);
+#endif
+  }
+  // a hash that slot_of() puts at slot
+  static size_type hash_at(size_type slot, size_type depth) {
+#if ADS_SET_MSB_INDEX
+    return slot << 1 << (hash_bits - 1 - depth);
+#else
+    (void)depth;
+    return slot;
+#endif
+  }
+  // the hash bit that splits a bucket of depth local
+  static size_type split_bit(size_type local) {
+#if ADS_SET_MSB_INDEX
+    return size_type{1} << (hash_bits - 1 - local);
+#else
+    return size_type{1} << local;
+#endif
+  }
+  // the slot bit telling a bucket of depth local from its buddy
+  static size_type buddy_bit(size_type local, size_type depth) {
+#if ADS_SET_MSB_INDEX
+    return size_type{1} << (depth - local);
+#else
+    (void)depth;
+    return size_type{1} << (local - 1);
+#endif
+  }
+  // point every alias of slot at, taken at depth local, to bucket
+  static void fill(Bucket **table, size_type depth, size_type at,
+                   size_type local, Bucket *bucket) {
+#if ADS_SET_MSB_INDEX
+    size_type run = size_type{1} << (depth - local);
+    std::fill_n(table + (at & ~(run - 1)), run, bucket);
+#else
+    size_type stride = size_type{1} << local;
+    for (size_type i = at & (stride - 1); i < size_type{1} << depth;
+         i += stride)
+      table[i] = bucket;
+#endif
+  }
+  // spread 2^depth slots over 2^(depth + 1), the table having room for them
+  static void widen(Bucket **table, size_type depth) {
+    size_type size = size_type{1} << depth;
+#if ADS_SET_MSB_INDEX
+    for (size_type i = size; i-- > 0;) // back to front, so in place
+      table[2 * i] = table[2 * i + 1] = table[i];
+#else
+    std::copy(table, table + size, table + size);
+#endif
+  }
+  // undo widen() once no bucket is deeper than depth
+  static void narrow(Bucket **table, size_type depth) {
+#if ADS_SET_MSB_INDEX
+    for (size_type i{0}; i < size_type{1} << depth; ++i)
+      table[i] = table[2 * i];
+#else
+    (void)table, (void)depth; // the low half already is the table
+#endif
+  }
   //////////   DIRECTORY   //////////
-  struct Directory {
+  struct Directory : HeldHash, HeldEqual {
+    using table_allocator = typename std::allocator_traits<
+        Allocator>::template rebind_alloc<Bucket *>;
+    using table_traits = std::allocator_traits<table_allocator>;
+    using owners_allocator = typename std::allocator_traits<
+        Allocator>::template rebind_alloc<std::atomic<size_type>>;
+    using owners_traits = std::allocator_traits<owners_allocator>;
+    // A vector of bucket pointers whose storage a snapshot can borrow; the
+    // Directory tracks who else uses it.
+    class BucketList {
+      table_allocator alloc;
+      Bucket **items{nullptr};
+      size_type used{0};
+      size_type room{0};
+
+    public:
+      explicit BucketList(const table_allocator &a) : alloc(a) {}
+      BucketList(BucketList &&other) noexcept
+          : alloc(std::move(other.alloc)), items(other.items),
+            used(other.used), room(other.room) {
+        other.forget();
+      }
+      BucketList(const BucketList &) = delete;
+      BucketList &operator=(const BucketList &) = delete;
+      ~BucketList() {
+        if (items)
+          table_traits::deallocate(alloc, items, room);
+      }
+      size_type size() const { return used; }
+      bool empty() const { return used == 0; }
+      Bucket *&operator[](size_type i) { return items[i]; }
+      Bucket *operator[](size_type i) const { return items[i]; }
+      Bucket *back() const { return items[used - 1]; }
+      Bucket **begin() const { return items; }
+      Bucket **end() const { return items + used; }
+      void reserve(size_type n) {
+        if (n <= room)
+          return;
+        Bucket **grown = table_traits::allocate(alloc, n);
+        std::copy(items, items + used, grown);
+        if (items)
+          table_traits::deallocate(alloc, items, room);
+        items = grown;
+        room = n;
+      }
+      void push_back(Bucket *bucket) {
+        if (used == room)
+          reserve(room ? room << 1 : 8);
+        items[used++] = bucket;
+      }
+      void pop_back() { --used; }
+      void clear() { used = 0; }
+      // use other's storage without owning it
+      void borrow(const BucketList &other) {
+        items = other.items;
+        used = other.used;
+        room = other.room;
+      }
+      void forget() {
+        items = nullptr;
+        used = room = 0;
+      }
+      void swap(BucketList &other) {
+        using std::swap;
+        swap(alloc, other.alloc);
+        swap(items, other.items);
+        swap(used, other.used);
+        swap(room, other.room);
+      }
+    };
     size_type global_depth;
+    size_type capacity; // slots allocated, 0 while on the empty table
+    size_type deepest;  // buckets with local_depth == global_depth
     Bucket **buckets;
-    Directory(size_type depth, size_t val = 1) : global_depth(depth) {
-      size_type size = 1 << global_depth;
-      buckets = new Bucket *[size];
-      if (val == 1)
-        for (size_t i{0}; i < size; ++i) {
-          buckets[i] = new Bucket(global_depth);
-        }
+    BucketPool pool;
+    table_allocator alloc;
+    // every distinct bucket once, in iteration order; holes are hole()
+    BucketList list;
+    // directories using this table and list, null while we are the only one
+    std::atomic<size_type> *owners{nullptr};
+    size_type seed{0}; // xor-ed into the raw hash before the mix
+    Directory(const Allocator &a, const hasher &hash, const key_equal &equal)
+        : HeldHash(hash), HeldEqual(equal), global_depth(0), capacity(0),
+          deepest(0), buckets(empty_table()), pool(a), alloc(a), list(alloc) {}
+    Directory(Directory &&other) noexcept
+        : HeldHash(other), HeldEqual(other), global_depth(other.global_depth),
+          capacity(other.capacity),
+          deepest(other.deepest), buckets(other.buckets),
+          pool(std::move(other.pool)), alloc(std::move(other.alloc)),
+          list(std::move(other.list)), owners(other.owners),
+          seed(other.seed) {
+      other.global_depth = other.capacity = other.deepest = 0;
+      other.buckets = empty_table();
+      other.owners = nullptr;
+    }
+    Directory(const Directory &) = delete;
+    Directory &operator=(const Directory &) = delete;
+    const hasher &hash_function() const { return HeldHash::held(); }
+    const key_equal &key_eq() const { return HeldEqual::held(); }
+    template <typename K> size_type hash(const K &key) const {
+      return mixed(hash_function()(key));
+    }
+    // what the directory indexes by, given the hasher's result
+    size_type mixed(size_type raw) const {
+      if (mixing && (!avalanching<hasher>::value || seed != 0))
+        return mix(raw ^ seed);
+      return raw;
     }
     ~Directory() {
-      size_type size = 1 << global_depth;
-      bool *deleted = new bool[size]{false}; // Track which buckets have been deleted
-      for (size_type i{0}; i < size; ++i) {
-        if (!deleted[i]) {
-          for (size_type j = i; j < size; j += (1 << buckets[i]->local_depth)) {
-            deleted[j] = true; // Mark all references to this bucket as deleted
-          }
-          delete buckets[i];
+      if (capacity == 0)
+        return;
+      if (!disown()) {
+        list.forget();
+        return;
+      }
+      release_buckets();
+      table_traits::deallocate(alloc, buckets, capacity);
+    }
+    // Let into, an empty directory, use our table and list. Neither side
+    // writes to them again, see own().
+    void share(Directory &into) {
+      if (capacity == 0)
+        return;
+      pool.share(into.pool);
+      if (!owners) {
+        owners_allocator owners_alloc(alloc);
+        owners = owners_traits::allocate(owners_alloc, 1);
+        owners_traits::construct(owners_alloc, owners, size_type{1});
+      }
+      owners->fetch_add(1, std::memory_order_relaxed);
+      into.owners = owners;
+      into.seed = seed;
+      into.global_depth = global_depth;
+      into.capacity = capacity;
+      into.deepest = deepest;
+      into.buckets = buckets;
+      into.list.borrow(list);
+    }
+    // Drop our claim on a shared table and list. True if nobody else holds
+    // one, and the caller is left to release them.
+    bool disown() {
+      std::atomic<size_type> *counter = owners;
+      owners = nullptr;
+      if (!counter)
+        return true;
+      if (counter->fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return false;
+      owners_allocator owners_alloc(alloc);
+      owners_traits::destroy(owners_alloc, counter);
+      owners_traits::deallocate(owners_alloc, counter, 1);
+      return true;
+    }
+    // Before the first write after a snapshot, copy the shared table and list.
+    // Each bucket gains an owner and is copied itself once written to.
+    void own() {
+      if (owners)
+        copy_shared();
+    }
+    void copy_shared() {
+      if (owners->load(std::memory_order_acquire) == 1) {
+        disown();
+        return;
+      }
+      size_type size = size_type{1} << global_depth;
+      BucketList copy(alloc);
+      copy.reserve(list.size());
+      Bucket **table = table_traits::allocate(alloc, capacity);
+      std::copy(buckets, buckets + size, table);
+      for (Bucket *bucket : list) {
+        if (bucket != hole())
+          bucket->owners.fetch_add(1, std::memory_order_relaxed);
+        copy.push_back(bucket);
+      }
+      list.swap(copy);
+      std::swap(buckets, table);
+      if (disown()) { // the others let go meanwhile
+        for (Bucket *bucket : copy)
+          if (bucket != hole())
+            release(bucket);
+        table_traits::deallocate(alloc, table, capacity);
+      } else {
+        copy.forget();
+      }
+    }
+    static bool shared(const Bucket *bucket) {
+      return bucket->owners.load(std::memory_order_acquire) != 1;
+    }
+    // Replace the shared bucket at slot at, and its aliases, by a copy of
+    // our own. The copy keeps its position.
+    Bucket *own_bucket(Bucket *bucket, size_type at) {
+      Bucket *copy = pool.acquire(*bucket);
+      list[copy->position] = copy;
+      fill(buckets, global_depth, at, bucket->local_depth, copy);
+      release(bucket);
+      return copy;
+    }
+    // back into the pool once no other directory lists the bucket
+    void release(Bucket *bucket) {
+      if (!shared(bucket) ||
+          bucket->owners.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        pool.release(bucket);
+    }
+    // the first write gives the set its own two buckets
+    void materialize() {
+      if (capacity != 0)
+        return;
+      buckets = table_traits::allocate(alloc, 2);
+      capacity = 2;
+      global_depth = 1;
+      deepest = 2;
+      for (size_t i{0}; i < capacity; ++i) {
+        buckets[i] = make_bucket(global_depth);
+      }
+    }
+    template <typename... Args> Bucket *make_bucket(Args &&...args) {
+      Bucket *bucket = pool.acquire(std::forward<Args>(args)...);
+      try {
+        list.push_back(bucket);
+      } catch (...) {
+        pool.release(bucket);
+        throw;
+      }
+      bucket->position = list.size() - 1;
+      return bucket;
+    }
+    // The last bucket in the list takes over the dropped one's position. A
+    // shared bucket must keep its position, so a hole is left instead.
+    void drop_bucket(Bucket *bucket) {
+      size_type at = bucket->position;
+      list[at] = hole();
+      release(bucket);
+      while (!list.empty() && list.back() == hole())
+        list.pop_back();
+      if (at < list.size() && !shared(list.back())) {
+        Bucket *last = list.back();
+        list.pop_back();
+        list[at] = last;
+        last->position = at;
+      }
+    }
+    // Copy other's shape into this empty directory: every distinct bucket is
+    // cloned once, in list order, and each slot points at the clone that sits
+    // at its source bucket's position.
+    void clone(const Directory &other) {
+      if (other.capacity == 0)
+        return;
+      size_type size = size_type{1} << other.global_depth;
+      try {
+        list.reserve(other.list.size());
+        for (Bucket *bucket : other.list) {
+          if (bucket == hole())
+            list.push_back(bucket);
+          else
+            make_bucket(*bucket);
         }
+        buckets = table_traits::allocate(alloc, size);
+      } catch (...) {
+        release_buckets();
+        throw;
       }
-      delete[] deleted;
-      delete[] buckets;
+      capacity = size;
+      seed = other.seed;
+      global_depth = other.global_depth;
+      deepest = other.deepest;
+      for (size_type i{0}; i < size; ++i)
+        buckets[i] = list[other.buckets[i]->position];
+    }
+    void release_buckets() {
+      for (Bucket *bucket : list)
+        if (bucket != hole())
+          release(bucket);
+      list.clear();
+    }
+    // make room for 2^depth slots, reusing the table when it is big enough
+    void reserve(size_type depth) {
+      size_type size = size_type{1} << depth;
+      if (size <= capacity)
+        return;
+      Bucket **table = table_traits::allocate(alloc, size);
+      std::copy(buckets, buckets + (size_type{1} << global_depth), table);
+      table_traits::deallocate(alloc, buckets, capacity);
+      buckets = table;
+      capacity = size;
+    }
+    // give the table back once it is four times larger than needed, leaving
+    // room for one doubling so a set hovering at a boundary does not thrash
+    void shrink() {
+      size_type size = size_type{1} << global_depth;
+      if (capacity < size << 2)
+        return;
+      Bucket **table = table_traits::allocate(alloc, size << 1);
+      std::copy(buckets, buckets + size, table);
+      table_traits::deallocate(alloc, buckets, capacity);
+      buckets = table;
+      capacity = size << 1;
+    }
+    void swap(Directory &other) {
+      using std::swap;
+      swap(static_cast<HeldHash &>(*this), static_cast<HeldHash &>(other));
+      swap(static_cast<HeldEqual &>(*this), static_cast<HeldEqual &>(other));
+      swap(global_depth, other.global_depth);
+      swap(capacity, other.capacity);
+      swap(deepest, other.deepest);
+      swap(buckets, other.buckets);
+      swap(alloc, other.alloc);
+      swap(owners, other.owners);
+      swap(seed, other.seed);
+      list.swap(other.list);
+      pool.swap(other.pool);
     }
   };
+  //////////   BULK LOAD   //////////
+  // Keys of one partition share the `shift` hash bits slot_of() reads first,
+  // so its table is indexed by the bits after them. Bucket depths stay
+  // relative to the partition until bulk_load stitches the partitions into
+  // one directory.
+  struct Partition {
+    using table_allocator = typename Directory::table_allocator;
+    BucketPool pool;
+    std::vector<Bucket *, table_allocator> table; // 2^depth slots
+    std::vector<Bucket *, table_allocator> list;
+    size_type shift;
+    size_type depth{0};
+    size_type size{0};
+    const Directory &functions; // hasher and key_equal of the set
+    Partition(const Allocator &a, size_type shift, const Directory &functions)
+        : pool(a), table(table_allocator(a)), list(table_allocator(a)),
+          shift(shift), functions(functions) {}
+    Partition(Partition &&) = default;
+    ~Partition() {
+      for (Bucket *bucket : list)
+        pool.release(bucket);
+    }
+    Bucket *make_bucket(size_type local_depth) {
+      Bucket *bucket = pool.acquire(local_depth);
+      try {
+        list.push_back(bucket);
+      } catch (...) {
+        pool.release(bucket);
+        throw;
+      }
+      return bucket;
+    }
+    size_type slot(size_type hash) const {
+#if ADS_SET_MSB_INDEX
+      return slot_of(hash << shift, depth);
+#else
+      return slot_of(hash >> shift, depth);
+#endif
+    }
+    void add(const key_type &key, size_type hash) {
+      Bucket *bucket = table[slot(hash)];
+      if (bucket->locate(key, hash, functions.key_eq()) < bucket->count)
+        return;
+      while (bucket->isFull()) {
+        split(hash);
+        bucket = table[slot(hash)];
+      }
+      bucket->insert(key, hash);
+      ++size;
+    }
+    void split(size_type hash) {
+      Bucket *old_bucket = table[slot(hash)];
+      if (old_bucket->local_depth == depth) {
+        table.resize(table.size() << 1);
+        widen(table.data(), depth);
+        ++depth;
+      }
+      size_type local = old_bucket->local_depth;
+      Bucket *new_bucket = make_bucket(local + 1);
+      fill(table.data(), depth, slot(hash) | buddy_bit(local + 1, depth),
+           local + 1, new_bucket);
+      old_bucket->divide(*new_bucket, split_bit(shift + local), functions);
+      ++old_bucket->local_depth;
+    }
+  };
+  // keys each bulk load thread should get at least
+  static constexpr size_type bulk_min_keys = size_type{1} << 16;
+  static size_type bulk_threads(size_type n);
+  // runs task(0) .. task(threads - 1), task(0) on the calling thread, and
+  // rethrows the first exception once all of them finished
+  template <typename Task>
+  static void run_parallel(size_type threads, const Task &task);
+  template <typename RandomIt>
+  void bulk_load(RandomIt first, size_type n, size_type threads);
   //////////   INSTANZ VARS   //////////
   Directory directory;
+  // the bucket at hash, copied first if a snapshot shares it
+  Bucket *writable(size_type hash) {
+    Bucket *bucket = directory.buckets[hash];
+    if (!Directory::shared(bucket))
+      return bucket;
+    return directory.own_bucket(bucket, hash);
+  }
   void split_bucket(size_type hash);
   void double_catalog();
+  void merge_bucket(size_type hash);
+  void halve_catalog();
+  void deepen(size_type depth); // split every bucket down to depth
   size_t add_feed{0};
   size_type current_size{0};
-  size_type h(const key_type &key) const {
-    return hasher{}(key) & ((1 << directory.global_depth) - 1);
+  size_type merge_limit{N / 2};
+  size_type reserved_depth{1}; // merges stop here, set by reserve()
+  size_type skew_slack{8};
+  size_type reseeded_at{0}; // size at the last reseed
+  // Doubling the directory past the depth a uniform hash would need for this
+  // size, about depth_for(size) * (N + 1) / N, plus skew_slack means many keys
+  // share their low hash bits. Small tables are left alone, and after a
+  // reseed the size has to double first, in case the raw hashes collide.
+  bool skewed() const {
+    size_type depth = directory.global_depth + 1;
+    if (!mixing || skew_slack == 0 || depth < 16 ||
+        current_size < 2 * reseeded_at)
+      return false;
+    size_type needed = std::max(reserved_depth, depth_for(current_size));
+    return depth > needed * (N + 1) / N + skew_slack;
+  }
+  void reseed();
+  // smallest depth that holds n keys at about 2/3 bucket occupancy
+  static size_type depth_for(size_type n) {
+    size_type per_bucket = std::max<size_type>(1, N * 2 / 3);
+    size_type depth = 1;
+    while ((size_type{1} << depth) * per_bucket < n)
+      ++depth;
+    return depth;
+  }
+  template <typename K> size_type hash_of(const K &key) const {
+    return directory.hash(key);
+  }
+  size_type index(size_type hash) const {
+    return slot_of(hash, directory.global_depth);
   }
-  size_type hashed(const key_type &key, size_t mod) const {
-    return hasher{}(key) & ((1 << mod) - 1);
+  // Iterators walk Directory::list, or under ADS_SET_MSB_INDEX the table,
+  // from each bucket's first slot to the one past its aliases.
+  const Bucket *walk_bucket(size_type at) const {
+#if ADS_SET_MSB_INDEX
+    return directory.buckets[at];
+#else
+    return directory.list[at];
+#endif
   }
+  size_type walk_end() const {
+#if ADS_SET_MSB_INDEX
+    return size_type{1} << directory.global_depth;
+#else
+    return directory.list.size();
+#endif
+  }
+  size_type walk_next(size_type at) const {
+#if ADS_SET_MSB_INDEX
+    return at + (size_type{1} << (directory.global_depth -
+                                  directory.buckets[at]->local_depth));
+#else
+    return at + 1;
+#endif
+  }
+  // where an iterator stands on the bucket at slot
+  size_type walk_start(size_type slot) const {
+#if ADS_SET_MSB_INDEX
+    size_type run = size_type{1} << (directory.global_depth -
+                                     directory.buckets[slot]->local_depth);
+    return slot & ~(run - 1);
+#else
+    return directory.buckets[slot]->position;
+#endif
+  }
+  // raw is what the hasher returned, so a reseed can mix it again
+  template <typename K> size_t add_hashed(K &&key, size_type raw);
+  // count, find and erase for key_type and transparent K alike
+  template <typename K>
+  size_type count_key(const K &key, size_type full_hash) const;
+  template <typename K>
+  const_iterator find_key(const K &key, size_type full_hash) const;
+  template <typename K> size_type erase_key(const K &key, size_type full_hash);
+  // iterator to the slot add() reported
+  std::pair<iterator, bool> inserted(size_type old_size, size_type hash) const;
+  // keys looked up per group in the batched probes
+  static constexpr size_type lookup_group = 16;
+  template <typename Report>
+  void lookup_many(const key_type *keys, size_type n, Report report) const;
+#ifdef __cpp_impl_coroutine
+  // One coroutine per interleaved lane. It is created suspended and
+  // suspends again after each prefetch it issues.
+  struct LookupLane {
+    struct promise_type {
+      LookupLane get_return_object() {
+        return LookupLane{
+            std::coroutine_handle<promise_type>::from_promise(*this)};
+      }
+      std::suspend_always initial_suspend() noexcept { return {}; }
+      std::suspend_always final_suspend() noexcept { return {}; }
+      void return_void() {}
+      void unhandled_exception() { throw; }
+    };
+    std::coroutine_handle<promise_type> handle;
+    explicit LookupLane(std::coroutine_handle<promise_type> h) : handle(h) {}
+    LookupLane(LookupLane &&other) noexcept
+        : handle(std::exchange(other.handle, nullptr)) {}
+    LookupLane &operator=(LookupLane &&) = delete;
+    ~LookupLane() {
+      if (handle)
+        handle.destroy();
+    }
+  };
+  // Looks up keys[first], keys[first + stride], ... The directory slot of
+  // the next key is prefetched together with the current bucket, so a lane
+  // suspends once per lookup.
+  LookupLane lookup_lane(const key_type *keys, size_type n, size_type first,
+                         size_type stride, bool *found) const {
+    if (first >= n)
+      co_return;
+    size_type hash = hash_of(keys[first]);
+    __builtin_prefetch(directory.buckets + index(hash));
+    co_await std::suspend_always{};
+    for (size_type i = first; i < n; i += stride) {
+      const Bucket *bucket = directory.buckets[index(hash)];
+      bucket->prefetch();
+      size_type next_hash = 0;
+      if (i + stride < n) {
+        next_hash = hash_of(keys[i + stride]);
+        __builtin_prefetch(directory.buckets + index(next_hash));
+      }
+      co_await std::suspend_always{};
+      found[i] =
+          bucket->locate(keys[i], hash, directory.key_eq()) < bucket->count;
+      hash = next_hash;
+    }
+  }
+#endif
 
 public:
   // constructors
   ADS_set();
+  explicit ADS_set(const allocator_type &alloc);
+  explicit ADS_set(size_type capacity,
+                   const allocator_type &alloc = allocator_type());
+  // for stateful (e.g. seeded) hashers; the copies are kept in the set
+  ADS_set(size_type capacity, const hasher &hash,
+          const key_equal &equal = key_equal(),
+          const allocator_type &alloc = allocator_type());
   ADS_set(std::initializer_list<key_type> ilist);
   ADS_set(const ADS_set &other);
+  ADS_set(ADS_set &&other) noexcept;
 
+  // Ranges may hold duplicates, so only an explicit capacity reserves.
   template <typename InputIt> ADS_set(InputIt first, InputIt last);
+  template <typename InputIt>
+  ADS_set(InputIt first, InputIt last, size_type capacity);
 
   ~ADS_set() {}
   // assignment
   ADS_set &operator=(const ADS_set &other);
+  ADS_set &operator=(ADS_set &&other) noexcept;
   ADS_set &operator=(std::initializer_list<key_type> ilist);
+  // O(1) copy sharing this set's directory and buckets. Whichever side writes
+  // first copies the directory, and then each bucket before writing to it, so
+  // the snapshot may be read on another thread while this set changes.
+  ADS_set snapshot();
   // inlines
   inline size_type size() const { return current_size; };
   inline bool empty() const { return current_size == 0; };
+  // Pre-split the directory for n keys, so evenly hashed keys go in with
+  // few or no doublings and splits.
+  // The reserved buckets stay in place through erase; clear() drops them.
+  void reserve(size_type n);
   // inserts
   void insert(std::initializer_list<key_type> ilist);
   std::pair<iterator, bool> insert(const key_type &key);
+  std::pair<iterator, bool> insert(key_type &&key);
+  template <typename... Args> std::pair<iterator, bool> emplace(Args &&...args);
   size_t add(const key_type &key);
+  size_t add(key_type &&key);
 
+  // With ADS_SET_BULK_THREADS set above 1 (or to 0), random-access ranges of
+  // at least 2 * 2^16 keys going into an empty set are partitioned by hash
+  // and built on several threads, see there. Which of several equal keys in
+  // the range is kept is then unspecified, as for std::unordered_set.
   template <typename InputIt> void insert(InputIt first, InputIt last);
   // remove
   void clear();
-  size_type erase(const key_type &key);
+  size_type erase(const key_type &key) { return erase_key(key, hash_of(key)); }
+  template <typename K, if_transparent<K> = 0>
+  size_type erase(const K &key) {
+    return erase_key(key, hash_of(key));
+  }
+  // Buddy buckets merge on erase once their combined count drops to this
+  // value. The default of N / 2 leaves half a bucket of slack before the
+  // merged bucket splits again; values are capped at N.
+  size_type merge_threshold() const { return merge_limit; }
+  void merge_threshold(size_type combined) {
+    merge_limit = std::min(combined, N);
+  }
+  // An insert that would double the directory this many levels past what
+  // the size needs rehashes everything under a new seed instead, which also
+  // defuses hash flooding. Default 8, 0 never reseeds.
+  size_type reseed_slack() const { return skew_slack; }
+  void reseed_slack(size_type depth) { skew_slack = depth; }
   // search
-  size_type count(const key_type &key) const; // PH1
-  iterator find(const key_type &key) const;
+  size_type count(const key_type &key) const { // PH1
+    return count_key(key, hash_of(key));
+  }
+  bool contains(const key_type &key) const { return count(key) != 0; }
+  iterator find(const key_type &key) const {
+    return find_key(key, hash_of(key));
+  }
+  // With Hash::is_transparent and KeyEqual::is_transparent, count, contains,
+  // find and erase also take any K both accept, e.g. a std::string_view into
+  // an ADS_set<std::string>, without building a key_type first.
+  template <typename K, if_transparent<K> = 0>
+  size_type count(const K &key) const {
+    return count_key(key, hash_of(key));
+  }
+  template <typename K, if_transparent<K> = 0>
+  bool contains(const K &key) const {
+    return count_key(key, hash_of(key)) != 0;
+  }
+  template <typename K, if_transparent<K> = 0>
+  iterator find(const K &key) const {
+    return find_key(key, hash_of(key));
+  }
+  // For callers that already hashed the key, e.g. to pick a partition:
+  // hash must be what hash_function() returns for key, and the set still
+  // mixes it with its seed. Any other value leaves the key unfindable.
+  std::pair<iterator, bool> insert_hashed(const key_type &key,
+                                          size_type hash);
+  std::pair<iterator, bool> insert_hashed(key_type &&key, size_type hash);
+  size_type count_hashed(const key_type &key, size_type hash) const {
+    return count_key(key, directory.mixed(hash));
+  }
+  iterator find_hashed(const key_type &key, size_type hash) const {
+    return find_key(key, directory.mixed(hash));
+  }
+  size_type erase_hashed(const key_type &key, size_type hash) {
+    return erase_key(key, directory.mixed(hash));
+  }
+  // Batched lookups of keys[0..n). count_many sets bit i of found, which
+  // needs (n + 63) / 64 words, when keys[i] is present and returns the
+  // number of hits; contains_many writes one bool per key instead.
+  size_type count_many(const key_type *keys, size_type n,
+                       std::uint64_t *found) const;
+  void contains_many(const key_type *keys, size_type n, bool *found) const;
+#ifdef __cpp_impl_coroutine
+  // C++20: contains_many as `lanes` coroutines interleaved on this thread,
+  // each suspending after the prefetch of a directory slot or a bucket.
+  void contains_interleaved(const key_type *keys, size_type n, bool *found,
+                            size_type lanes = 16) const;
+#endif
   // swap
   void swap(ADS_set &other);
+  allocator_type get_allocator() const {
+    return directory.pool.get_allocator();
+  }
+  hasher hash_function() const { return directory.hash_function(); }
+  key_equal key_eq() const { return directory.key_eq(); }
   // iterator
   const_iterator begin() const;
   const_iterator end() const;
@@ -130,23 +1333,12 @@ public:
     if (lhs.current_size != rhs.current_size) {
       return false;
     }
-    size_type size = 1 << lhs.directory.global_depth;
-    bool *visited = new bool[size]{false};
-    for (size_t i{0}; i < size; ++i) {
-      if (!visited[i]) {
-        for (size_t j{0}; j < lhs.directory.buckets[i]->count; ++j) {
-          if (rhs.count(lhs.directory.buckets[i]->elements[j]) == 0) {
-            delete[] visited;
-            return false;
-          }
-        }
-        for (size_type j = i; j < size; j += (1 << lhs.directory.buckets[i]->local_depth)) {
-          if (lhs.directory.buckets[i] == lhs.directory.buckets[j])
-            visited[j] = true;
-        }
+    for (const Bucket *bucket : lhs.directory.list) {
+      for (size_t j{0}; j < bucket->count; ++j) {
+        if (rhs.count(bucket->elements[j]) == 0)
+          return false;
       }
     }
-    delete[] visited;
     return true;
   };
   friend bool operator!=(const ADS_set &lhs, const ADS_set &rhs) {
@@ -156,14 +1348,15 @@ public:
   void dump(std::ostream &o = std::cerr) const {
     o << "ADS_set dump:\n";
     o << "Global depth: " << directory.global_depth << "\n";
-    size_t num_buckets = 1 << directory.global_depth;
-    for (size_t i = 0; i < num_buckets; ++i) {
-      o << "Bucket " << i << " Address: " << directory.buckets[i]
-        << " (local depth: " << directory.buckets[i]->local_depth
-        << ", size: " << directory.buckets[i]->size
-        << ", count: " << directory.buckets[i]->count << "): ";
-      for (size_t j = 0; j < directory.buckets[i]->count; ++j) {
-        o << directory.buckets[i]->elements[j] << " - ";
+    for (const Bucket *bucket : directory.list) {
+      if (bucket == hole())
+        continue;
+      o << "Bucket " << bucket->position << " Address: " << bucket
+        << " (local depth: " << bucket->local_depth
+        << ", size: " << bucket->size << ", count: " << bucket->count
+        << "): ";
+      for (size_t j = 0; j < bucket->count; ++j) {
+        o << bucket->elements[j] << " - ";
       }
       o << "\n";
     }
@@ -172,234 +1365,717 @@ public:
 
 //////////   CONSTR & ASS   ////////////////////   CONSTR & ASS   //////////
 
-template <typename Key, size_t N> ADS_set<Key, N>::ADS_set() : directory(1) {}
-template <typename Key, size_t N>
-ADS_set<Key, N>::ADS_set(std::initializer_list<key_type> ilist) : ADS_set() {
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+ADS_set<Key, N, Allocator, Hash, KeyEqual>::ADS_set()
+    : ADS_set(allocator_type()) {}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+ADS_set<Key, N, Allocator, Hash, KeyEqual>::ADS_set(const allocator_type &alloc)
+    : directory(alloc, hasher(), key_equal()) {}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+ADS_set<Key, N, Allocator, Hash, KeyEqual>::ADS_set(
+    size_type capacity, const allocator_type &alloc)
+    : ADS_set(alloc) {
+  reserve(capacity);
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+ADS_set<Key, N, Allocator, Hash, KeyEqual>::ADS_set(
+    size_type capacity, const hasher &hash, const key_equal &equal,
+    const allocator_type &alloc)
+    : directory(alloc, hash, equal) {
+  reserve(capacity);
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+ADS_set<Key, N, Allocator, Hash, KeyEqual>::ADS_set(
+    std::initializer_list<key_type> ilist)
+    : ADS_set() {
   insert(ilist);
 }
-template <typename Key, size_t N>
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
 template <typename InputIt>
-ADS_set<Key, N>::ADS_set(InputIt first, InputIt last) : ADS_set() {
+ADS_set<Key, N, Allocator, Hash, KeyEqual>::ADS_set(InputIt first,
+                                                    InputIt last)
+    : ADS_set() {
   insert(first, last);
 }
-template <typename Key, size_t N>
-ADS_set<Key, N>::ADS_set(const ADS_set &other)
-    : ADS_set{other.begin(), other.end()} {}
-template <typename Key, size_t N>
-ADS_set<Key, N> &ADS_set<Key, N>::operator=(const ADS_set<Key, N> &other) {
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+template <typename InputIt>
+ADS_set<Key, N, Allocator, Hash, KeyEqual>::ADS_set(InputIt first,
+                                                    InputIt last,
+                                                    size_type capacity)
+    : ADS_set(capacity) {
+  insert(first, last);
+}
+// Structural copy: same directory shape, each bucket copied once, no rehash.
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+ADS_set<Key, N, Allocator, Hash, KeyEqual>::ADS_set(const ADS_set &other)
+    : directory(std::allocator_traits<Allocator>::
+                    select_on_container_copy_construction(
+                        other.get_allocator()),
+                other.directory.hash_function(), other.directory.key_eq()),
+      merge_limit(other.merge_limit), reserved_depth(other.reserved_depth),
+      skew_slack(other.skew_slack), reseeded_at(other.reseeded_at) {
+  directory.clone(other.directory);
+  current_size = other.current_size;
+}
+// the moved-from set is left empty on the shared empty table
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+ADS_set<Key, N, Allocator, Hash, KeyEqual>::ADS_set(ADS_set &&other) noexcept
+    : directory(std::move(other.directory)), current_size(other.current_size),
+      merge_limit(other.merge_limit), reserved_depth(other.reserved_depth),
+      skew_slack(other.skew_slack), reseeded_at(other.reseeded_at) {
+  other.current_size = 0;
+  other.reserved_depth = 1;
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+ADS_set<Key, N, Allocator, Hash, KeyEqual> &
+ADS_set<Key, N, Allocator, Hash, KeyEqual>::operator=(
+    ADS_set &&other) noexcept {
+  ADS_set moved(std::move(other));
+  swap(moved);
+  return *this;
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+ADS_set<Key, N, Allocator, Hash, KeyEqual> &
+ADS_set<Key, N, Allocator, Hash, KeyEqual>::operator=(
+    const ADS_set &other) {
   if (this == &other) {
     return *this;
   }
-  clear();
-  insert(other.begin(), other.end());
+  ADS_set copy(other);
+  swap(copy);
   return *this;
 }
-template <typename Key, size_t N>
-ADS_set<Key, N> &
-ADS_set<Key, N>::operator=(std::initializer_list<key_type> ilist) {
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+ADS_set<Key, N, Allocator, Hash, KeyEqual> &
+ADS_set<Key, N, Allocator, Hash, KeyEqual>::operator=(
+    std::initializer_list<key_type> ilist) {
   clear();
   insert(ilist);
   return *this;
 }
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+ADS_set<Key, N, Allocator, Hash, KeyEqual>
+ADS_set<Key, N, Allocator, Hash, KeyEqual>::snapshot() {
+  ADS_set copy(0, hash_function(), key_eq(), get_allocator());
+  directory.share(copy.directory);
+  copy.current_size = current_size;
+  copy.merge_limit = merge_limit;
+  copy.reserved_depth = reserved_depth;
+  copy.skew_slack = skew_slack;
+  copy.reseeded_at = reseeded_at;
+  return copy;
+}
 
 //////////   BUCKET MANAGEMENT   ////////////////////   BUCKET MANAGEMENT
 ////////////////
 
-template <typename Key, size_t N>
-void ADS_set<Key, N>::split_bucket(size_type hash) {
-  Bucket *old_bucket = directory.buckets[hash];
-  size_type new_local = old_bucket->local_depth + 1;
-  Bucket *new_bucket = new Bucket(new_local);
-  size_type mask = (1 << old_bucket->local_depth);
-  for (size_type i = 0; i < static_cast<size_type>(1 << directory.global_depth);
-       ++i) {
-    if ((i & (mask - 1)) == (hash & (mask - 1))) {
-      if (i & mask) {
-        directory.buckets[i] = new_bucket;
-      } else {
-        directory.buckets[i] = old_bucket;
-      }
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void ADS_set<Key, N, Allocator, Hash, KeyEqual>::split_bucket(size_type hash) {
+  Bucket *old_bucket = writable(hash);
+  size_type local = old_bucket->local_depth;
+  size_type new_local = local + 1;
+  Bucket *new_bucket = directory.make_bucket(new_local);
+  // only the aliases with the buddy bit set move, so this touches
+  // 2^(global_depth - local_depth - 1) slots
+  fill(directory.buckets, directory.global_depth,
+       hash | buddy_bit(new_local, directory.global_depth), new_local,
+       new_bucket);
+  old_bucket->divide(*new_bucket, split_bit(local), directory);
+  old_bucket->local_depth = new_local;
+  if (new_local == directory.global_depth)
+    directory.deepest += 2;
+}
+
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void ADS_set<Key, N, Allocator, Hash, KeyEqual>::double_catalog() {
+  directory.reserve(directory.global_depth + 1);
+  widen(directory.buckets, directory.global_depth);
+  ++directory.global_depth;
+  directory.deepest = 0;
+}
+
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void ADS_set<Key, N, Allocator, Hash, KeyEqual>::merge_bucket(size_type hash) {
+  Bucket *bucket = directory.buckets[hash];
+  while (bucket->local_depth > reserved_depth) {
+    size_type local = bucket->local_depth;
+    size_type high = buddy_bit(local, directory.global_depth);
+    Bucket *buddy = directory.buckets[hash ^ high];
+    if (buddy->local_depth != local ||
+        bucket->count + buddy->count > merge_limit)
+      break;
+    // the bucket without the high bit survives and takes over its buddy,
+    // whose elements are copied if a snapshot still shares it
+    Bucket *keep = (hash & high) ? writable(hash ^ high) : bucket;
+    Bucket *gone = (hash & high) ? bucket : buddy;
+    bool shared = Directory::shared(gone);
+    for (size_type i{0}; i < gone->count; ++i) {
+      if (shared)
+        keep->copy_slot(keep->count++, *gone, i);
+      else
+        keep->move_slot(keep->count++, *gone, i);
     }
+    fill(directory.buckets, directory.global_depth, hash, local - 1, keep);
+    keep->local_depth = local - 1;
+    if (local == directory.global_depth)
+      directory.deepest -= 2;
+    directory.drop_bucket(gone);
+    bucket = keep;
+    hash &= ~high;
   }
-  size_type old_count = old_bucket->count;
-  old_bucket->count = 0; // Reset count for reorganizing elements
-  for (size_type i = 0; i < old_count; ++i) {
-    size_type new_hash = h(old_bucket->elements[i]);
-    if ((new_hash & mask) == 0) {
-      old_bucket->insert(old_bucket->elements[i]);
-    } else {
-      new_bucket->insert(old_bucket->elements[i]);
+  halve_catalog();
+}
+
+// With no bucket at full depth, every slot equals its widen() twin.
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void ADS_set<Key, N, Allocator, Hash, KeyEqual>::halve_catalog() {
+  if (directory.deepest != 0 || directory.global_depth == 1)
+    return;
+  while (directory.deepest == 0 && directory.global_depth > 1) {
+    --directory.global_depth;
+    narrow(directory.buckets, directory.global_depth);
+    size_type size = size_type{1} << directory.global_depth;
+    for (size_type i{0}; i < size; ++i) {
+      if (directory.buckets[i]->local_depth == directory.global_depth)
+        ++directory.deepest;
     }
   }
-  old_bucket->local_depth = new_local;
+  directory.shrink();
+  if (directory.pool.mostly_idle())
+    directory.pool.trim();
 }
 
-template <typename Key, size_t N> void ADS_set<Key, N>::double_catalog() {
-  size_type size = 1 << directory.global_depth;
-  size_type new_size = size << 1;
-  Bucket **newBuckets = new Bucket *[new_size];
-  for (size_t i{0}; i < size; ++i) {
-    newBuckets[i] = directory.buckets[i];
-    newBuckets[i + size] = directory.buckets[i];
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void ADS_set<Key, N, Allocator, Hash, KeyEqual>::reserve(size_type n) {
+  size_type depth = depth_for(n);
+  if (depth <= reserved_depth)
+    return;
+  reserved_depth = depth;
+  directory.materialize();
+  directory.own();
+  deepen(depth);
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void ADS_set<Key, N, Allocator, Hash, KeyEqual>::deepen(size_type depth) {
+  while (directory.global_depth < depth)
+    double_catalog();
+  size_type size = size_type{1} << directory.global_depth;
+  for (size_type i{0}; i < size; ++i) {
+    while (directory.buckets[i]->local_depth < depth)
+      split_bucket(i);
   }
-  delete[] directory.buckets;
-  directory.buckets = newBuckets;
-  ++directory.global_depth;
+}
+// Rebuilds the set under a seed taken from the clock and the set's address.
+// Keys are copied rather than moved, so a throwing insert leaves the set as
+// it was, and buckets a snapshot shares stay intact.
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void ADS_set<Key, N, Allocator, Hash, KeyEqual>::reseed() {
+  ADS_set rehashed(0, hash_function(), key_eq(), get_allocator());
+  auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+  rehashed.directory.seed =
+      mix(directory.seed ^ static_cast<size_type>(now) ^
+          reinterpret_cast<std::uintptr_t>(this)) |
+      1;
+  rehashed.merge_limit = merge_limit;
+  rehashed.skew_slack = skew_slack;
+  rehashed.reseeded_at = current_size;
+  rehashed.reserve(current_size);
+  rehashed.reserved_depth = reserved_depth;
+  for (const Bucket *bucket : directory.list)
+    for (size_type i{0}; i < bucket->count; ++i)
+      rehashed.add(bucket->elements[i]);
+  swap(rehashed);
 }
 
 //////////   INSERTS   ////////////////////   INSERTS   //////////
 
-template <typename Key, size_t N>
-size_t ADS_set<Key, N>::add(const key_type &key) {
-  size_type hash = h(key);
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+size_t ADS_set<Key, N, Allocator, Hash, KeyEqual>::add(const key_type &key) {
+  return add_hashed(key, directory.hash_function()(key));
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+size_t ADS_set<Key, N, Allocator, Hash, KeyEqual>::add(key_type &&key) {
+  size_type raw = directory.hash_function()(key);
+  return add_hashed(std::move(key), raw);
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+template <typename K>
+size_t ADS_set<Key, N, Allocator, Hash, KeyEqual>::add_hashed(K &&key,
+                                                             size_type raw) {
+  directory.materialize();
+  size_type full_hash = directory.mixed(raw);
+  size_type hash = index(full_hash);
   Bucket *bucket = directory.buckets[hash];
-  for (size_t i = 0; i < bucket->count; ++i) {
-    if (key_equal{}(bucket->elements[i], key)) {
-      add_feed = i; // mark second location for iterator constr
-      return hash;  // Key already exists, return hash for iterator constr
-    }
+  size_type at = bucket->locate(key, full_hash, directory.key_eq());
+  if (at < bucket->count) {
+    add_feed = at; // mark second location for iterator constr
+    return hash;   // Key already exists, return hash for iterator constr
   }
+  directory.own();
   while (bucket->split()) {
     if (bucket->local_depth == directory.global_depth) {
+      if (skewed()) {
+        reseed();
+        return add_hashed(std::forward<K>(key), raw);
+      }
       double_catalog();
-      hash = h(key);
+      hash = index(full_hash);
       bucket = directory.buckets[hash];
     }
     split_bucket(hash);
-    hash = h(key);
+    hash = index(full_hash);
     bucket = directory.buckets[hash];
   }
-  bucket->insert(key);
+  bucket = writable(hash);
+  bucket->insert(std::forward<K>(key), full_hash);
   ++current_size;
   return hash; // key inserted, return hash for interator constr
 }
-template <typename Key, size_t N>
-void ADS_set<Key, N>::insert(std::initializer_list<key_type> ilist) {
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void ADS_set<Key, N, Allocator, Hash, KeyEqual>::insert(
+    std::initializer_list<key_type> ilist) {
   insert(ilist.begin(), ilist.end());
 }
-template <typename Key, size_t N>
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
 template <typename InputIt>
-void ADS_set<Key, N>::insert(const InputIt first, InputIt last) {
+void ADS_set<Key, N, Allocator, Hash, KeyEqual>::insert(const InputIt first,
+                                                        InputIt last) {
+  using category = typename std::iterator_traits<InputIt>::iterator_category;
+  if constexpr (std::is_base_of<std::random_access_iterator_tag,
+                                category>::value) {
+    if (current_size == 0 && first != last) {
+      size_type n = static_cast<size_type>(last - first);
+      size_type threads = bulk_threads(n);
+      if (threads > 1) {
+        bulk_load(first, n, threads);
+        return;
+      }
+    }
+  }
   for (auto it{first}; it != last; ++it) {
     add(*it);
   }
 }
-template <typename Key, size_t N>
-std::pair<typename ADS_set<Key, N>::iterator, bool>
-ADS_set<Key, N>::insert(const typename ADS_set<Key, N>::key_type &key) {
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+std::pair<typename ADS_set<Key, N, Allocator, Hash, KeyEqual>::iterator, bool>
+ADS_set<Key, N, Allocator, Hash, KeyEqual>::insert(
+    const key_type &key) {
   size_t curr = current_size;
-  size_t hash = add(key);
-  hash = hashed(key, directory.buckets[hash]->local_depth);
-  if (curr == current_size) {
-    return {iterator(this, hash, add_feed, true), false};
+  return inserted(curr, add(key));
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+std::pair<typename ADS_set<Key, N, Allocator, Hash, KeyEqual>::iterator, bool>
+ADS_set<Key, N, Allocator, Hash, KeyEqual>::insert(
+    key_type &&key) {
+  size_t curr = current_size;
+  return inserted(curr, add(std::move(key)));
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+std::pair<typename ADS_set<Key, N, Allocator, Hash, KeyEqual>::iterator, bool>
+ADS_set<Key, N, Allocator, Hash, KeyEqual>::insert_hashed(const key_type &key,
+                                                          size_type hash) {
+  size_t curr = current_size;
+  return inserted(curr, add_hashed(key, hash));
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+std::pair<typename ADS_set<Key, N, Allocator, Hash, KeyEqual>::iterator, bool>
+ADS_set<Key, N, Allocator, Hash, KeyEqual>::insert_hashed(key_type &&key,
+                                                          size_type hash) {
+  size_t curr = current_size;
+  return inserted(curr, add_hashed(std::move(key), hash));
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+template <typename... Args>
+std::pair<typename ADS_set<Key, N, Allocator, Hash, KeyEqual>::iterator, bool>
+ADS_set<Key, N, Allocator, Hash, KeyEqual>::emplace(Args &&...args) {
+  return insert(key_type(std::forward<Args>(args)...));
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+std::pair<typename ADS_set<Key, N, Allocator, Hash, KeyEqual>::iterator, bool>
+ADS_set<Key, N, Allocator, Hash, KeyEqual>::inserted(
+    size_type old_size, size_type hash) const {
+  const Bucket *bucket = directory.buckets[hash];
+  if (old_size == current_size) {
+    return {iterator(this, walk_start(hash), add_feed, true), false};
   }
-  return {iterator(this, hash, (directory.buckets[hash]->count) - 1, true), true};
+  return {iterator(this, walk_start(hash), bucket->count - 1, true), true};
 }
 
-//////////   REMOVE   ////////////////////   REMOVE   //////////
+//////////   BULK LOAD   ////////////////////   BULK LOAD   //////////
 
-template <typename Key, size_t N> void ADS_set<Key, N>::clear() {
-  size_type size = 1 << directory.global_depth;
-  bool *cleared =
-      new bool[size]{false}; // Track which buckets have been deleted
-  for (size_type i{0}; i < size; ++i) {
-    if (!cleared[i]) {
-      for (size_type j = i; j < size;
-           j += (1 << directory.buckets[i]->local_depth)) {
-        cleared[j] = true; // Mark all references to this bucket as deleted
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+typename ADS_set<Key, N, Allocator, Hash, KeyEqual>::size_type
+ADS_set<Key, N, Allocator, Hash, KeyEqual>::bulk_threads(size_type n) {
+  size_type threads = ADS_SET_BULK_THREADS;
+  if (threads == 0)
+    threads = std::thread::hardware_concurrency();
+  return std::min(threads, n / bulk_min_keys);
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+template <typename Task>
+void ADS_set<Key, N, Allocator, Hash, KeyEqual>::run_parallel(
+    size_type threads, const Task &task) {
+  std::vector<std::exception_ptr> errors(threads);
+  auto guarded = [&task, &errors](size_type t) {
+    try {
+      task(t);
+    } catch (...) {
+      errors[t] = std::current_exception();
+    }
+  };
+  std::vector<std::thread> workers;
+  workers.reserve(threads);
+  for (size_type t{1}; t < threads; ++t) {
+    try {
+      workers.emplace_back(guarded, t);
+    } catch (...) {
+      guarded(t); // no thread to spare, run it here
+    }
+  }
+  guarded(0);
+  for (std::thread &worker : workers)
+    worker.join();
+  for (std::exception_ptr &error : errors) {
+    if (error)
+      std::rethrow_exception(error);
+  }
+}
+// Radix-partitions the keys on the first `shift` bits slot_of() reads,
+// builds every partition on its own, then stitches the partitions into one
+// directory: slot i takes the bucket that a hash landing at i finds in its
+// partition. A partition bucket of depth d covers exactly the slots of a
+// depth shift + d bucket, so nothing moves.
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+template <typename RandomIt>
+void ADS_set<Key, N, Allocator, Hash, KeyEqual>::bulk_load(
+    RandomIt first, size_type n, size_type threads) {
+  using size_allocator = typename std::allocator_traits<
+      Allocator>::template rebind_alloc<size_type>;
+  using entry = std::pair<size_type, size_type>; // hash, position in range
+  using entry_allocator =
+      typename std::allocator_traits<Allocator>::template rebind_alloc<entry>;
+  using partition_allocator = typename std::allocator_traits<
+      Allocator>::template rebind_alloc<Partition>;
+  Allocator alloc = get_allocator();
+  // a few partitions per thread even out skewed ones
+  size_type shift = 1;
+  while ((size_type{1} << shift) < threads * 4)
+    ++shift;
+  size_type parts = size_type{1} << shift;
+  auto chunk = [n, threads](size_type t) { return n / threads * t; };
+  auto chunk_end = [n, threads, &chunk](size_type t) {
+    return t + 1 == threads ? n : chunk(t + 1);
+  };
+
+  // Each thread hashes its chunk once into entries and groups them by
+  // partition in place (American flag sort), so partition p's entries are
+  // run p of every chunk: [bounds(t)[p], bounds(t)[p + 1]). Behind the
+  // bounds each thread keeps its fill cursors.
+  std::vector<entry, entry_allocator> entries(n, entry(), alloc);
+  size_type stride = 2 * parts + 1;
+  std::vector<size_type, size_allocator> runs(threads * stride, 0, alloc);
+  auto bounds = [&runs, stride](size_type t) {
+    return runs.data() + t * stride;
+  };
+  run_parallel(threads, [&](size_type t) {
+    size_type *bound = bounds(t);
+    for (size_type i = chunk(t); i < chunk_end(t); ++i) {
+      size_type hash = hash_of(first[i]);
+      entries[i] = entry(hash, i);
+      ++bound[slot_of(hash, shift) + 1];
+    }
+    bound[0] = chunk(t);
+    for (size_type p{0}; p < parts; ++p)
+      bound[p + 1] += bound[p];
+    size_type *next = bound + parts + 1;
+    std::copy(bound, bound + parts, next);
+    for (size_type p{0}; p < parts; ++p) {
+      while (next[p] < bound[p + 1]) {
+        entry &at = entries[next[p]];
+        size_type home = slot_of(at.first, shift);
+        if (home == p)
+          ++next[p];
+        else
+          std::swap(at, entries[next[home]++]);
+      }
+    }
+  });
+
+  std::vector<Partition, partition_allocator> built(alloc);
+  built.reserve(parts);
+  for (size_type p{0}; p < parts; ++p)
+    built.emplace_back(alloc, shift, directory);
+  run_parallel(threads, [&](size_type t) {
+    for (size_type p = t; p < parts; p += threads) {
+      Partition &part = built[p];
+      part.table.push_back(part.make_bucket(0));
+      for (size_type c{0}; c < threads; ++c) {
+        const size_type *bound = bounds(c);
+        for (size_type j = bound[p]; j < bound[p + 1]; ++j)
+          part.add(first[entries[j].second], entries[j].first);
       }
-      delete directory.buckets[i];
     }
+  });
+  std::vector<entry, entry_allocator>(alloc).swap(entries);
+
+  Directory stitched(alloc, hash_function(), key_eq());
+  stitched.seed = directory.seed;
+  size_type depth{0}, count{0}, size{0};
+  for (const Partition &part : built) {
+    depth = std::max(depth, part.depth);
+    count += part.list.size();
+    size += part.size;
   }
-  delete[] cleared;
-  delete[] directory.buckets;
+  stitched.list.reserve(count);
+  size_type global = shift + depth;
+  stitched.buckets =
+      Directory::table_traits::allocate(stitched.alloc, size_type{1} << global);
+  stitched.capacity = size_type{1} << global;
+  stitched.global_depth = global;
+  for (size_type i{0}; i < stitched.capacity; ++i) {
+    size_type hash = hash_at(i, global);
+    const Partition &part = built[slot_of(hash, shift)];
+    stitched.buckets[i] = part.table[part.slot(hash)];
+  }
+  for (Partition &part : built) {
+    for (Bucket *bucket : part.list) {
+      bucket->local_depth += shift;
+      bucket->position = stitched.list.size();
+      stitched.list.push_back(bucket);
+      if (bucket->local_depth == global)
+        ++stitched.deepest;
+    }
+    part.list.clear();
+    stitched.pool.adopt(part.pool);
+  }
+  directory.swap(stitched);
+  current_size = size;
+  deepen(reserved_depth);
+}
+
+//////////   REMOVE   ////////////////////   REMOVE   //////////
+
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void ADS_set<Key, N, Allocator, Hash, KeyEqual>::clear() {
+  current_size = 0;
+  reserved_depth = 1;
+  if (directory.capacity == 0)
+    return;
+  if (directory.owners) { // leave table and buckets to the snapshot
+    Directory fresh(get_allocator(), hash_function(), key_eq());
+    fresh.seed = directory.seed;
+    directory.swap(fresh);
+    return;
+  }
+  directory.release_buckets(); // back into the pool, table is kept
   directory.global_depth = 1;
-  directory.buckets = new Bucket *[1 << directory.global_depth];
   for (size_t i{0}; i < static_cast<size_t>(1 << directory.global_depth); ++i) {
-    directory.buckets[i] = new Bucket(directory.global_depth);
+    directory.buckets[i] = directory.make_bucket(directory.global_depth);
   }
-  current_size = 0;
+  directory.deepest = 2;
 }
-template <typename Key, size_t N>
-typename ADS_set<Key, N>::size_type
-ADS_set<Key, N>::erase(const key_type &key) {
-  auto elem_ptr = find(key);
-  if (elem_ptr == end())
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+template <typename K>
+typename ADS_set<Key, N, Allocator, Hash, KeyEqual>::size_type
+ADS_set<Key, N, Allocator, Hash, KeyEqual>::erase_key(const K &key,
+                                                      size_type full_hash) {
+  size_t bucket_index = index(full_hash);
+  Bucket *bucket = directory.buckets[bucket_index];
+  size_t element_index =
+      bucket->locate(key, full_hash, directory.key_eq());
+  if (element_index == bucket->count)
     return 0;
-  size_t bucket_index = elem_ptr.get_buck();
-  size_t element_index = elem_ptr.get_ele();
-  auto &bucket = directory.buckets[bucket_index];
-  for (size_t i{element_index}; i < bucket->count - 1; ++i) {
-    bucket->elements[i] = bucket->elements[i + 1];
+  directory.own();
+  bucket = writable(bucket_index);
+  // slot order is irrelevant, so the last slot fills the hole
+  if (element_index + 1 < bucket->count) {
+    bucket->move_slot(element_index, *bucket, bucket->count - 1);
   }
   bucket->count--;
   current_size--;
+  merge_bucket(bucket_index);
   return 1;
 }
 
 //////////   SEARCH   ////////////////////   SEARCH   //////////
 
-template <typename Key, size_t N>
-typename ADS_set<Key, N>::size_type
-ADS_set<Key, N>::count(const key_type &key) const {
-  size_type hash = h(key);
-  Bucket *bucket = directory.buckets[hash];
-  if (bucket->count != 0) {
-    for (size_t i{0}; i < bucket->count; ++i) {
-      if (key_equal{}(bucket->elements[i], key)) {
-        return 1;
-      }
-    }
-  }
-  return 0;
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+template <typename K>
+typename ADS_set<Key, N, Allocator, Hash, KeyEqual>::size_type
+ADS_set<Key, N, Allocator, Hash, KeyEqual>::count_key(
+    const K &key, size_type full_hash) const {
+  Bucket *bucket = directory.buckets[index(full_hash)];
+  return bucket->locate(key, full_hash, directory.key_eq()) < bucket->count
+             ? 1
+             : 0;
 }
 
-template <typename Key, size_t N>
-typename ADS_set<Key, N>::const_iterator
-ADS_set<Key, N>::find(const key_type &key) const {
-  size_type hash = h(key);
-  hash = hashed(key, directory.buckets[hash]->local_depth);
-  Bucket *bucket = directory.buckets[hash];
-  if (bucket->count == 0) {
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+template <typename K>
+typename ADS_set<Key, N, Allocator, Hash, KeyEqual>::const_iterator
+ADS_set<Key, N, Allocator, Hash, KeyEqual>::find_key(
+    const K &key, size_type full_hash) const {
+  Bucket *bucket = directory.buckets[index(full_hash)];
+  size_type at = bucket->locate(key, full_hash, directory.key_eq());
+  if (at == bucket->count) {
     return end();
   }
-  for (size_t i{0}; i < bucket->count; ++i) {
-    if (key_equal{}(bucket->elements[i], key)) {
-      return const_iterator(this, hash, i, true);
+  return const_iterator(this, walk_start(index(full_hash)), at, true);
+}
+
+// A group's keys are hashed and their directory slots prefetched, then their
+// buckets are prefetched, and only then probed, so the directory and bucket
+// misses of a whole group overlap instead of stalling each lookup in turn.
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+template <typename Report>
+void ADS_set<Key, N, Allocator, Hash, KeyEqual>::lookup_many(
+    const key_type *keys, size_type n, Report report) const {
+  size_type hashes[lookup_group];
+  const Bucket *buckets[lookup_group];
+  for (size_type base{0}; base < n; base += lookup_group) {
+    size_type group = std::min(lookup_group, n - base);
+    for (size_type j{0}; j < group; ++j) {
+      hashes[j] = hash_of(keys[base + j]);
+      __builtin_prefetch(directory.buckets + index(hashes[j]));
+    }
+    for (size_type j{0}; j < group; ++j) {
+      buckets[j] = directory.buckets[index(hashes[j])];
+      buckets[j]->prefetch();
+    }
+    for (size_type j{0}; j < group; ++j) {
+      const Bucket *bucket = buckets[j];
+      size_type at =
+          bucket->locate(keys[base + j], hashes[j], directory.key_eq());
+      report(base + j, at < bucket->count);
+    }
+  }
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+typename ADS_set<Key, N, Allocator, Hash, KeyEqual>::size_type
+ADS_set<Key, N, Allocator, Hash, KeyEqual>::count_many(
+    const key_type *keys, size_type n, std::uint64_t *found) const {
+  std::fill_n(found, (n + 63) / 64, std::uint64_t{0});
+  size_type hits{0};
+  lookup_many(keys, n, [&](size_type i, bool hit) {
+    found[i / 64] |= std::uint64_t{hit} << (i % 64);
+    hits += hit;
+  });
+  return hits;
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void ADS_set<Key, N, Allocator, Hash, KeyEqual>::contains_many(
+    const key_type *keys, size_type n, bool *found) const {
+  lookup_many(keys, n, [&](size_type i, bool hit) { found[i] = hit; });
+}
+
+#ifdef __cpp_impl_coroutine
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void ADS_set<Key, N, Allocator, Hash, KeyEqual>::contains_interleaved(
+    const key_type *keys, size_type n, bool *found, size_type lanes) const {
+  lanes = std::max(size_type{1}, std::min(lanes, n));
+  std::vector<LookupLane> running;
+  running.reserve(lanes);
+  for (size_type l{0}; l < lanes; ++l)
+    running.push_back(lookup_lane(keys, n, l, lanes, found));
+  // round robin: by the time a lane is resumed, its prefetch has had a
+  // whole round of other lanes' work to land
+  for (size_type active = lanes; active > 0;) {
+    for (LookupLane &lane : running) {
+      if (lane.handle.done())
+        continue;
+      lane.handle.resume();
+      if (lane.handle.done())
+        --active;
     }
   }
-  return end();
 }
+#endif
 
 //////////   SWAPS   ////////////////////   SWAPS   //////////
 
-template <typename Key, size_t N>
-void swap(ADS_set<Key, N> &lhs, ADS_set<Key, N> &rhs) {
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void swap(ADS_set<Key, N, Allocator, Hash, KeyEqual> &lhs,
+          ADS_set<Key, N, Allocator, Hash, KeyEqual> &rhs) {
   lhs.swap(rhs);
 }
-template <typename Key, size_t N> void ADS_set<Key, N>::swap(ADS_set &other) {
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void ADS_set<Key, N, Allocator, Hash, KeyEqual>::swap(ADS_set &other) {
   std::swap(this->current_size, other.current_size);
-  std::swap(this->directory.global_depth, other.directory.global_depth);
-  std::swap(this->directory.buckets, other.directory.buckets);
+  std::swap(this->merge_limit, other.merge_limit);
+  std::swap(this->reserved_depth, other.reserved_depth);
+  std::swap(this->skew_slack, other.skew_slack);
+  std::swap(this->reseeded_at, other.reseeded_at);
+  this->directory.swap(other.directory);
 }
 
 //////////   ITERATOR   ////////////////////   ITERATOR   //////////
 
-template <typename Key, size_t N>
-typename ADS_set<Key, N>::const_iterator ADS_set<Key, N>::begin() const {
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+typename ADS_set<Key, N, Allocator, Hash, KeyEqual>::const_iterator
+ADS_set<Key, N, Allocator, Hash, KeyEqual>::begin() const {
   return const_iterator(this);
 }
-template <typename Key, size_t N>
-typename ADS_set<Key, N>::const_iterator ADS_set<Key, N>::end() const {
-  return const_iterator(this, 1 << directory.global_depth, 0);
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+typename ADS_set<Key, N, Allocator, Hash, KeyEqual>::const_iterator
+ADS_set<Key, N, Allocator, Hash, KeyEqual>::end() const {
+  return const_iterator(this, walk_end(), 0);
 }
 
-template <typename Key, size_t N> class ADS_set<Key, N>::Iterator {
+// Walks Directory::list, or the table in hash-prefix order under
+// ADS_SET_MSB_INDEX, so each step is O(1) whatever the directory depth.
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+class ADS_set<Key, N, Allocator, Hash, KeyEqual>::Iterator {
 private:
   const ADS_set *set;
-  size_t bucket_index{0};
+  size_t bucket_index{0}; // list position, or first slot, see walk_bucket()
   size_t element_index{0};
-  bool noskip{false};
 
 public:
   size_t get_buck() const { return bucket_index; }
@@ -420,10 +2096,10 @@ public:
   }
   ~Iterator() {}
   reference operator*() const {
-    return set->directory.buckets[bucket_index]->elements[element_index];
+    return set->walk_bucket(bucket_index)->elements[element_index];
   }
   pointer operator->() const {
-    return &(set->directory.buckets[bucket_index]->elements[element_index]);
+    return &(set->walk_bucket(bucket_index)->elements[element_index]);
   }
   Iterator &operator++() {
     if (isAtEnd()) {
@@ -431,10 +2107,6 @@ public:
     }
     ++element_index;
     skip();
-    if (isAtEnd()) {
-      bucket_index = static_cast<size_t>(1 << set->directory.global_depth);
-      element_index = 0;
-    }
     return *this;
   }
   Iterator operator++(int) {
@@ -450,34 +2122,18 @@ public:
     return !(lhs == rhs);
   }
   bool isAtEnd() const {
-    return (bucket_index) >=
-           static_cast<size_t>(1 << set->directory.global_depth);
+    return bucket_index >= set->walk_end();
   }
+  // move past empty buckets to the next element, or to end()
   void skip() {
-    size_type directory_size = 1 << set->directory.global_depth;
-    while (bucket_index < directory_size) {
-      if (element_index < set->directory.buckets[bucket_index]->count) {
-        bool is_lowest = true;
-        size_t local_step =
-            1 << set->directory.buckets[bucket_index]->local_depth;
-        for (size_t idx = bucket_index % local_step; idx < bucket_index;
-             idx += local_step) {
-          if (set->directory.buckets[idx] ==
-              set->directory.buckets[bucket_index]) {
-            is_lowest = false;
-            break;
-          }
-        }
-        if (is_lowest)
-          break;
-        ++bucket_index;
-      } else {
-        ++bucket_index;
-        element_index = 0;
-      }
+    size_t end = set->walk_end();
+    while (bucket_index < end &&
+           element_index >= set->walk_bucket(bucket_index)->count) {
+      bucket_index = set->walk_next(bucket_index);
+      element_index = 0;
     }
-    if (bucket_index >= directory_size) {
-      bucket_index = directory_size;
+    if (bucket_index >= end) {
+      bucket_index = end;
       element_index = 0;
     }
   }
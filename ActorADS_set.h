@@ -0,0 +1,656 @@
+#ifndef ACTOR_ADS_SET_H
+#define ACTOR_ADS_SET_H
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "ADS_set.h"
+
+// Empty polling rounds before an idle worker parks until a client flushes
+// requests to it; it yields between rounds after the first 64. 0 never
+// parks, which suits workers pinned to cores of their own but keeps every
+// worker at 100% CPU for as long as the set lives.
+#ifndef ADS_SET_ACTOR_SPIN
+#define ADS_SET_ACTOR_SPIN 1024
+#endif
+
+// Shared-nothing set: P worker threads each own a private ADS_set holding
+// one partition of the hash space, and nothing else ever touches it. Other
+// threads talk to the workers through a Client from connect(). A client
+// owns one pair of single-producer single-consumer rings per partition:
+// requests go out on one, replies come back on the other. Neither side
+// takes a lock, and each side publishes a whole batch with one store.
+//
+// The *_many calls stage a whole batch before waiting, so one round trip
+// is shared by many keys. Single-key calls are batches of one and pay the
+// full round trip. Clients must be gone before the set is destroyed.
+//
+// Workers poll their rings while there is work and for a while after,
+// then park, see ADS_SET_ACTOR_SPIN. Waking a parked worker costs the
+// client a lock and a notify, so sets fed in short bursts pay it often.
+template <typename Key, size_t N = 63, typename Allocator = std::allocator<Key>,
+          typename Hash = std::hash<Key>,
+          typename KeyEqual = std::equal_to<Key>>
+class ActorADS_set {
+public:
+  class Client;
+  using set_type = ADS_set<Key, N, Allocator, Hash, KeyEqual>;
+  using value_type = Key;
+  using key_type = Key;
+  using size_type = size_t;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+  using allocator_type = Allocator;
+
+private:
+  template <typename T>
+  using rebind =
+      typename std::allocator_traits<Allocator>::template rebind_alloc<T>;
+
+  //////////   RING   //////////
+  // Bounded SPSC queue. The producer stages items and publishes them with
+  // flush(); the consumer reads ready() items in place and frees them with
+  // consume(). Each side caches the other's index on its own cache line.
+  template <typename T> class Ring {
+    using traits = std::allocator_traits<rebind<T>>;
+    rebind<T> alloc;
+    T *items;
+    size_type mask;
+    alignas(64) std::atomic<size_type> head{0}; // consumed so far
+    alignas(64) std::atomic<size_type> tail{0}; // published so far
+    alignas(64) size_type staged{0};            // producer only
+    size_type head_seen{0};
+    alignas(64) size_type read{0};              // consumer only
+
+  public:
+    // capacity is rounded up to a power of two
+    Ring(size_type capacity, const allocator_type &a) : alloc(a) {
+      size_type size{1};
+      while (size < capacity)
+        size <<= 1;
+      items = traits::allocate(alloc, size);
+      size_type i{0};
+      try {
+        for (; i < size; ++i)
+          traits::construct(alloc, items + i);
+      } catch (...) {
+        while (i-- > 0)
+          traits::destroy(alloc, items + i);
+        traits::deallocate(alloc, items, size);
+        throw;
+      }
+      mask = size - 1;
+    }
+    Ring(const Ring &) = delete;
+    Ring &operator=(const Ring &) = delete;
+    ~Ring() {
+      for (size_type i{0}; i <= mask; ++i)
+        traits::destroy(alloc, items + i);
+      traits::deallocate(alloc, items, mask + 1);
+    }
+    // producer: free slots, looking at the consumer's index only when the
+    // cached one says full
+    size_type room() {
+      if (staged - head_seen > mask)
+        head_seen = head.load(std::memory_order_acquire);
+      return mask + 1 - (staged - head_seen);
+    }
+    bool push(const T &item) {
+      if (room() == 0)
+        return false;
+      items[staged & mask] = item; // may throw, staged is left as it was
+      ++staged;
+      return true;
+    }
+    void flush() { tail.store(staged, std::memory_order_release); }
+    // consumer
+    size_type ready() const {
+      return tail.load(std::memory_order_acquire) - read;
+    }
+    T &at(size_type i) { return items[(read + i) & mask]; }
+    void consume(size_type n) {
+      read += n;
+      head.store(read, std::memory_order_release);
+    }
+  };
+
+  //////////   CHANNELS   //////////
+  enum class Op : unsigned char { insert, erase, count, size };
+  struct Request {
+    size_type index; // position in the client's batch
+    Op op;
+    key_type key;
+    size_type hash; // the set's hasher on key, computed once by the client
+  };
+  struct Reply {
+    size_type index;
+    size_type result;
+    std::exception_ptr error; // set when the operation threw
+  };
+  // one client's link to one partition
+  struct Channel {
+    Ring<Request> requests;
+    Ring<Reply> replies;
+    Channel(size_type capacity, const allocator_type &a)
+        : requests(capacity, a), replies(capacity, a) {}
+  };
+  // Where an idle worker sleeps. It raises parked before its last look at
+  // the rings, a client looks at parked after publishing, and a seq_cst
+  // fence on both sides makes at least one of them see the other.
+  struct Doorbell {
+    std::atomic<bool> parked{false};
+    std::mutex lock;
+    std::condition_variable rung;
+    size_type rings{0}; // guarded by lock
+    void ring() {
+      {
+        std::lock_guard<std::mutex> hold(lock);
+        ++rings;
+      }
+      rung.notify_one();
+    }
+  };
+  struct alignas(64) Partition {
+    set_type set;
+    std::thread worker;
+    Doorbell bell;
+    Partition(const hasher &hash, const key_equal &equal,
+              const allocator_type &a)
+        : set(0, hash, equal, a) {}
+  };
+  using channel_traits = std::allocator_traits<rebind<Channel>>;
+  using partition_traits = std::allocator_traits<rebind<Partition>>;
+  using connected_traits = std::allocator_traits<rebind<std::atomic<bool>>>;
+
+  //////////   INSTANZ VARS   //////////
+  // every partition holds a copy; clients hash with this one
+  hasher hash;
+  rebind<Channel> channel_alloc;
+  rebind<Partition> partition_alloc;
+  rebind<std::atomic<bool>> connected_alloc;
+  size_type partitions;
+  size_type max_clients;
+  Partition *parts;
+  Channel *channels; // partition-major: channel(p, c)
+  std::atomic<bool> *connected; // per client slot, taken by connect()
+  std::atomic<size_type> clients_seen{0}; // workers poll clients below this
+  std::atomic<bool> stopping{false};
+
+  Channel &channel(size_type p, size_type c) {
+    return channels[p * max_clients + c];
+  }
+  // multiply-shift on a mixed hash, any partition count
+  size_type partition_of(size_type hash) const {
+    std::uint64_t mixed =
+        static_cast<std::uint64_t>(hash) * 0x9E3779B97F4A7C15ull;
+    return static_cast<size_type>(((mixed >> 32) * partitions) >> 32);
+  }
+  static size_type execute(set_type &set, Request &request);
+  void serve(size_type p);
+  // requests waiting for the worker of partition p
+  bool pending(size_type p);
+  // sleeps until a client or stop() rings p's doorbell
+  void park(size_type p);
+  // stops and joins the workers of the first count partitions
+  void stop(size_type count) noexcept;
+  void destroy_channels(size_type count) noexcept;
+  void destroy_partitions(size_type count) noexcept;
+  void destroy_connected() noexcept;
+
+public:
+  static size_type default_partitions() {
+    return std::max<size_type>(1, std::thread::hardware_concurrency());
+  }
+  // starts one worker per partition; ring_capacity bounds the requests a
+  // client can have in flight to one partition
+  explicit ActorADS_set(size_type partition_count = default_partitions(),
+                        size_type client_limit = 64,
+                        size_type ring_capacity = 1024,
+                        const allocator_type &a = allocator_type());
+  // for stateful (e.g. seeded) hashers; the copies are kept in the set
+  ActorADS_set(size_type partition_count, size_type client_limit,
+               size_type ring_capacity, const hasher &hash,
+               const key_equal &equal = key_equal(),
+               const allocator_type &a = allocator_type());
+  ActorADS_set(const ActorADS_set &) = delete;
+  ActorADS_set &operator=(const ActorADS_set &) = delete;
+  ~ActorADS_set();
+
+  size_type partition_count() const { return partitions; }
+  hasher hash_function() const { return hash; }
+  key_equal key_eq() const { return parts[0].set.key_eq(); }
+  // a free client slot, std::length_error once client_limit are connected
+  Client connect();
+};
+
+//////////   CLIENT   ////////////////////   CLIENT   //////////
+
+// One thread's handle on the set; not shareable between threads, but
+// movable. The results of a batch are in order of its keys.
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+class ActorADS_set<Key, N, Allocator, Hash, KeyEqual>::Client {
+  ActorADS_set *owner;
+  size_type id;
+  std::vector<size_type> outstanding; // replies still due per partition
+  std::vector<size_type> staged;      // partitions with unflushed requests
+  std::vector<bool> is_staged;
+
+  friend class ActorADS_set;
+  Client(ActorADS_set *set, size_type slot)
+      : owner(set), id(slot), outstanding(set->partitions, 0),
+        is_staged(set->partitions, false) {
+    staged.reserve(set->partitions);
+  }
+  // sends make(i), i < n, to partition target(request), collecting reply
+  // results through done(i, result); rethrows the first failure once the
+  // batch is settled
+  template <typename Target, typename Make, typename Done>
+  void run(size_type n, Target target, Make make, Done done);
+  // publishes the requests staged since the last flush
+  void flush_staged();
+  // after a failed make: sends what was staged and drops every reply still
+  // due, so the next run starts clean
+  void abandon();
+
+public:
+  Client(Client &&other) noexcept
+      : owner(other.owner), id(other.id),
+        outstanding(std::move(other.outstanding)),
+        staged(std::move(other.staged)),
+        is_staged(std::move(other.is_staged)) {
+    other.owner = nullptr;
+  }
+  Client &operator=(Client &&) = delete;
+  Client(const Client &) = delete;
+  Client &operator=(const Client &) = delete;
+  ~Client() {
+    if (owner)
+      owner->connected[id].store(false, std::memory_order_release);
+  }
+
+  bool insert(const key_type &key) { return insert_many(&key, 1, nullptr); }
+  size_type erase(const key_type &key) {
+    return erase_many(&key, 1, nullptr);
+  }
+  size_type count(const key_type &key) {
+    return contains_many(&key, 1, nullptr);
+  }
+  bool contains(const key_type &key) { return count(key) != 0; }
+  // sum over all partitions, each exact when its worker answers
+  size_type size();
+  bool empty() { return size() == 0; }
+
+  // Batched operations on keys[0..n): result i goes to out[i] when out is
+  // not null, and the number of true results is returned.
+  size_type insert_many(const key_type *keys, size_type n, bool *out);
+  size_type erase_many(const key_type *keys, size_type n, bool *out);
+  size_type contains_many(const key_type *keys, size_type n, bool *out);
+};
+
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+template <typename Target, typename Make, typename Done>
+void ActorADS_set<Key, N, Allocator, Hash, KeyEqual>::Client::run(
+    size_type n, Target target, Make make, Done done) {
+  size_type sent{0}, received{0};
+  std::exception_ptr error;
+  unsigned idle{0};
+  Request request{};
+  size_type made = n; // index of request, kept while its ring is full
+  while (received < n) {
+    // stage in order until a ring fills up, then flush what was staged
+    try {
+      for (; sent < n; ++sent) {
+        if (made != sent) {
+          request = make(sent);
+          made = sent;
+        }
+        size_type p = target(request);
+        Ring<Request> &ring = owner->channel(p, id).requests;
+        if (!ring.push(request))
+          break;
+        ++outstanding[p];
+        if (!is_staged[p]) {
+          is_staged[p] = true;
+          staged.push_back(p);
+        }
+      }
+    } catch (...) {
+      abandon();
+      throw;
+    }
+    flush_staged();
+    size_type before = received;
+    for (size_type p{0}; p < owner->partitions; ++p) {
+      if (outstanding[p] == 0)
+        continue;
+      Channel &channel = owner->channel(p, id);
+      size_type ready = channel.replies.ready();
+      for (size_type i{0}; i < ready; ++i) {
+        const Reply &reply = channel.replies.at(i);
+        if (reply.error) {
+          if (!error)
+            error = reply.error;
+        } else {
+          done(reply.index, reply.result);
+        }
+      }
+      channel.replies.consume(ready);
+      outstanding[p] -= ready;
+      received += ready;
+    }
+    if (received != before)
+      idle = 0;
+    else if (++idle > 64)
+      std::this_thread::yield();
+  }
+  if (error)
+    std::rethrow_exception(error);
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void ActorADS_set<Key, N, Allocator, Hash, KeyEqual>::Client::flush_staged() {
+  for (size_type p : staged) {
+    owner->channel(p, id).requests.flush();
+    is_staged[p] = false;
+  }
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  for (size_type p : staged) {
+    Doorbell &bell = owner->parts[p].bell;
+    if (bell.parked.load(std::memory_order_relaxed))
+      bell.ring();
+  }
+  staged.clear();
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void ActorADS_set<Key, N, Allocator, Hash, KeyEqual>::Client::abandon() {
+  flush_staged();
+  unsigned idle{0};
+  for (size_type p{0}; p < owner->partitions; ++p) {
+    Channel &channel = owner->channel(p, id);
+    while (outstanding[p] != 0) {
+      size_type ready = channel.replies.ready();
+      channel.replies.consume(ready);
+      outstanding[p] -= ready;
+      if (ready)
+        idle = 0;
+      else if (++idle > 64)
+        std::this_thread::yield();
+    }
+  }
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+typename ActorADS_set<Key, N, Allocator, Hash, KeyEqual>::size_type
+ActorADS_set<Key, N, Allocator, Hash, KeyEqual>::Client::size() {
+  size_type total{0};
+  run(owner->partitions, [](const Request &request) { return request.index; },
+      [](size_type i) { return Request{i, Op::size, key_type{}, 0}; },
+      [&total](size_type, size_type result) { total += result; });
+  return total;
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+typename ActorADS_set<Key, N, Allocator, Hash, KeyEqual>::size_type
+ActorADS_set<Key, N, Allocator, Hash, KeyEqual>::Client::insert_many(
+    const key_type *keys, size_type n, bool *out) {
+  size_type hits{0};
+  run(n,
+      [this](const Request &request) {
+        return owner->partition_of(request.hash);
+      },
+      [this, keys](size_type i) {
+        return Request{i, Op::insert, keys[i], owner->hash(keys[i])};
+      },
+      [&hits, out](size_type i, size_type result) {
+        hits += result;
+        if (out)
+          out[i] = result != 0;
+      });
+  return hits;
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+typename ActorADS_set<Key, N, Allocator, Hash, KeyEqual>::size_type
+ActorADS_set<Key, N, Allocator, Hash, KeyEqual>::Client::erase_many(
+    const key_type *keys, size_type n, bool *out) {
+  size_type hits{0};
+  run(n,
+      [this](const Request &request) {
+        return owner->partition_of(request.hash);
+      },
+      [this, keys](size_type i) {
+        return Request{i, Op::erase, keys[i], owner->hash(keys[i])};
+      },
+      [&hits, out](size_type i, size_type result) {
+        hits += result;
+        if (out)
+          out[i] = result != 0;
+      });
+  return hits;
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+typename ActorADS_set<Key, N, Allocator, Hash, KeyEqual>::size_type
+ActorADS_set<Key, N, Allocator, Hash, KeyEqual>::Client::contains_many(
+    const key_type *keys, size_type n, bool *out) {
+  size_type hits{0};
+  run(n,
+      [this](const Request &request) {
+        return owner->partition_of(request.hash);
+      },
+      [this, keys](size_type i) {
+        return Request{i, Op::count, keys[i], owner->hash(keys[i])};
+      },
+      [&hits, out](size_type i, size_type result) {
+        hits += result;
+        if (out)
+          out[i] = result != 0;
+      });
+  return hits;
+}
+
+//////////   WORKERS   ////////////////////   WORKERS   //////////
+
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+typename ActorADS_set<Key, N, Allocator, Hash, KeyEqual>::size_type
+ActorADS_set<Key, N, Allocator, Hash, KeyEqual>::execute(
+    set_type &set, Request &request) {
+  switch (request.op) {
+  case Op::insert:
+    return set.insert_hashed(std::move(request.key), request.hash).second;
+  case Op::erase:
+    return set.erase_hashed(request.key, request.hash);
+  case Op::count:
+    return set.count_hashed(request.key, request.hash);
+  case Op::size:
+    break;
+  }
+  return set.size();
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void ActorADS_set<Key, N, Allocator, Hash, KeyEqual>::serve(size_type p) {
+  set_type &set = parts[p].set;
+  unsigned idle{0};
+  while (!stopping.load(std::memory_order_acquire)) {
+    bool busy = false;
+    size_type clients = clients_seen.load(std::memory_order_acquire);
+    for (size_type c{0}; c < clients; ++c) {
+      Channel &link = channel(p, c);
+      // never more than the replies can take, so a worker never waits
+      size_type n = std::min(link.requests.ready(), link.replies.room());
+      for (size_type i{0}; i < n; ++i) {
+        Request &request = link.requests.at(i);
+        Reply reply{request.index, 0, nullptr};
+        try {
+          reply.result = execute(set, request);
+        } catch (...) {
+          reply.error = std::current_exception();
+        }
+        link.replies.push(reply);
+      }
+      if (n) {
+        link.requests.consume(n);
+        link.replies.flush();
+        busy = true;
+      }
+    }
+    if (busy) {
+      idle = 0;
+    } else if (++idle > ADS_SET_ACTOR_SPIN && ADS_SET_ACTOR_SPIN != 0) {
+      park(p);
+      idle = 0;
+    } else if (idle > 64) {
+      std::this_thread::yield();
+    }
+  }
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+bool ActorADS_set<Key, N, Allocator, Hash, KeyEqual>::pending(size_type p) {
+  size_type clients = clients_seen.load(std::memory_order_acquire);
+  for (size_type c{0}; c < clients; ++c) {
+    if (channel(p, c).requests.ready() != 0)
+      return true;
+  }
+  return false;
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void ActorADS_set<Key, N, Allocator, Hash, KeyEqual>::park(size_type p) {
+  Doorbell &bell = parts[p].bell;
+  std::unique_lock<std::mutex> hold(bell.lock);
+  size_type seen = bell.rings;
+  bell.parked.store(true, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (!pending(p) && !stopping.load(std::memory_order_acquire))
+    bell.rung.wait(hold, [&bell, seen] { return bell.rings != seen; });
+  bell.parked.store(false, std::memory_order_relaxed);
+}
+
+//////////   CONSTR   ////////////////////   CONSTR   //////////
+
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+ActorADS_set<Key, N, Allocator, Hash, KeyEqual>::ActorADS_set(
+    size_type partition_count, size_type client_limit, size_type ring_capacity,
+    const allocator_type &a)
+    : ActorADS_set(partition_count, client_limit, ring_capacity, hasher(),
+                   key_equal(), a) {}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+ActorADS_set<Key, N, Allocator, Hash, KeyEqual>::ActorADS_set(
+    size_type partition_count, size_type client_limit, size_type ring_capacity,
+    const hasher &hash, const key_equal &equal, const allocator_type &a)
+    : hash(hash), channel_alloc(a), partition_alloc(a), connected_alloc(a),
+      partitions(std::max<size_type>(1, partition_count)),
+      max_clients(std::max<size_type>(1, client_limit)), parts(nullptr),
+      channels(nullptr), connected(nullptr) {
+  connected = connected_traits::allocate(connected_alloc, max_clients);
+  for (size_type c{0}; c < max_clients; ++c)
+    connected_traits::construct(connected_alloc, connected + c, false);
+  size_type links = partitions * max_clients, made{0};
+  try {
+    channels = channel_traits::allocate(channel_alloc, links);
+    for (; made < links; ++made)
+      channel_traits::construct(channel_alloc, channels + made, ring_capacity,
+                                a);
+  } catch (...) {
+    destroy_channels(made);
+    destroy_connected();
+    throw;
+  }
+  made = 0;
+  try {
+    parts = partition_traits::allocate(partition_alloc, partitions);
+    for (; made < partitions; ++made)
+      partition_traits::construct(partition_alloc, parts + made, hash, equal,
+                                  a);
+    for (size_type p{0}; p < partitions; ++p)
+      parts[p].worker = std::thread(&ActorADS_set::serve, this, p);
+  } catch (...) {
+    stop(made);
+    destroy_partitions(made);
+    destroy_channels(links);
+    destroy_connected();
+    throw;
+  }
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+ActorADS_set<Key, N, Allocator, Hash, KeyEqual>::~ActorADS_set() {
+  stop(partitions);
+  destroy_partitions(partitions);
+  destroy_channels(partitions * max_clients);
+  destroy_connected();
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void ActorADS_set<Key, N, Allocator, Hash, KeyEqual>::stop(
+    size_type count) noexcept {
+  stopping.store(true, std::memory_order_release);
+  for (size_type p{0}; p < count; ++p) {
+    parts[p].bell.ring();
+    if (parts[p].worker.joinable())
+      parts[p].worker.join();
+  }
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void ActorADS_set<Key, N, Allocator, Hash, KeyEqual>::destroy_channels(
+    size_type count) noexcept {
+  if (!channels)
+    return;
+  while (count-- > 0)
+    channel_traits::destroy(channel_alloc, channels + count);
+  channel_traits::deallocate(channel_alloc, channels,
+                             partitions * max_clients);
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void ActorADS_set<Key, N, Allocator, Hash, KeyEqual>::destroy_partitions(
+    size_type count) noexcept {
+  if (!parts)
+    return;
+  while (count-- > 0)
+    partition_traits::destroy(partition_alloc, parts + count);
+  partition_traits::deallocate(partition_alloc, parts, partitions);
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void ActorADS_set<Key, N, Allocator, Hash, KeyEqual>::destroy_connected()
+    noexcept {
+  for (size_type c{0}; c < max_clients; ++c)
+    connected_traits::destroy(connected_alloc, connected + c);
+  connected_traits::deallocate(connected_alloc, connected, max_clients);
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+typename ActorADS_set<Key, N, Allocator, Hash, KeyEqual>::Client
+ActorADS_set<Key, N, Allocator, Hash, KeyEqual>::connect() {
+  for (size_type c{0}; c < max_clients; ++c) {
+    bool expected = false;
+    if (connected[c].compare_exchange_strong(expected, true,
+                                             std::memory_order_acq_rel)) {
+      size_type seen = clients_seen.load(std::memory_order_relaxed);
+      while (seen <= c &&
+             !clients_seen.compare_exchange_weak(seen, c + 1,
+                                                 std::memory_order_release))
+        ;
+      return Client(this, c);
+    }
+  }
+  throw std::length_error("ActorADS_set::connect: no free client slot");
+}
+
+#endif // ACTOR_ADS_SET_H
@@ -0,0 +1,239 @@
+#ifndef CONCURRENT_ADS_SET_H
+#define CONCURRENT_ADS_SET_H
+
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+
+#include "ADS_set.h"
+
+// Thread-safe set made of S independent ADS_set shards, S a power of two.
+// A key goes to the shard named by the high bits of its mixed hash; the
+// shard's own directory indexes with the low bits, so both stay spread.
+// Lookups take their shard's lock shared, modifications take it exclusive.
+// Aggregates (size, for_each) lock one shard at a time, so they are exact
+// per shard but not a snapshot of the whole set under concurrent writers.
+template <typename Key, size_t N = 63, typename Allocator = std::allocator<Key>,
+          typename Hash = std::hash<Key>,
+          typename KeyEqual = std::equal_to<Key>>
+class ConcurrentADS_set {
+public:
+  using set_type = ADS_set<Key, N, Allocator, Hash, KeyEqual>;
+  using value_type = Key;
+  using key_type = Key;
+  using size_type = size_t;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+  using allocator_type = Allocator;
+
+private:
+  //////////   SHARD   //////////
+  // a cache line of its own, so locking one shard does not bounce another
+  struct alignas(64) Shard {
+    mutable std::shared_mutex lock;
+    set_type set;
+    Shard(const hasher &hash, const key_equal &equal,
+          const allocator_type &alloc)
+        : set(0, hash, equal, alloc) {}
+  };
+  using shard_allocator = typename std::allocator_traits<
+      Allocator>::template rebind_alloc<Shard>;
+  using shard_traits = std::allocator_traits<shard_allocator>;
+
+  // every shard holds a copy; this one hashes keys before the lock
+  hasher hash;
+  shard_allocator alloc;
+  Shard *shards;
+  size_type shard_bits;
+
+  // top bits of a multiplicative mix, identity hashes would all land in 0
+  size_type shard_of(size_type hash) const {
+    if (shard_bits == 0)
+      return 0;
+    std::uint64_t mixed =
+        static_cast<std::uint64_t>(hash) * 0x9E3779B97F4A7C15ull;
+    return static_cast<size_type>(mixed >> (64 - shard_bits));
+  }
+  // the key is hashed once, outside the lock, and the shard reuses the hash
+  Shard &shard(size_type hash) const { return shards[shard_of(hash)]; }
+
+public:
+  // a few shards per hardware thread keeps two writers off the same lock
+  static size_type default_shards() {
+    return std::max<size_type>(1, std::thread::hardware_concurrency() * 4);
+  }
+  // shard_count is rounded up to a power of two
+  explicit ConcurrentADS_set(size_type shard_count = default_shards(),
+                             const allocator_type &a = allocator_type());
+  // for stateful (e.g. seeded) hashers; the copies are kept in the set
+  ConcurrentADS_set(size_type shard_count, const hasher &hash,
+                    const key_equal &equal = key_equal(),
+                    const allocator_type &a = allocator_type());
+  ConcurrentADS_set(const ConcurrentADS_set &) = delete;
+  ConcurrentADS_set &operator=(const ConcurrentADS_set &) = delete;
+  ~ConcurrentADS_set();
+
+  size_type shard_count() const { return size_type{1} << shard_bits; }
+  size_type size() const;
+  bool empty() const { return size() == 0; }
+  // reserves n / S keys, plus some slack for uneven shards, in every shard
+  void reserve(size_type n);
+
+  bool insert(const key_type &key);
+  bool insert(key_type &&key);
+  void insert(std::initializer_list<key_type> ilist);
+  template <typename InputIt> void insert(InputIt first, InputIt last);
+  size_type erase(const key_type &key);
+  void clear();
+
+  size_type count(const key_type &key) const;
+  bool contains(const key_type &key) const { return count(key) != 0; }
+  // f(key) for every key, one shard at a time under its shared lock; f must
+  // not call back into this set. There are no iterators: one would have to
+  // hold a shard lock from begin() to end(), or be invalidated by any
+  // concurrent insert into the shard it points into.
+  template <typename F> void for_each(F f) const;
+  hasher hash_function() const { return hash; }
+  key_equal key_eq() const { return shards[0].set.key_eq(); }
+};
+
+//////////   CONSTR   ////////////////////   CONSTR   //////////
+
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+ConcurrentADS_set<Key, N, Allocator, Hash, KeyEqual>::ConcurrentADS_set(
+    size_type shard_count, const allocator_type &a)
+    : ConcurrentADS_set(shard_count, hasher(), key_equal(), a) {}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+ConcurrentADS_set<Key, N, Allocator, Hash, KeyEqual>::ConcurrentADS_set(
+    size_type shard_count, const hasher &hash, const key_equal &equal,
+    const allocator_type &a)
+    : hash(hash), alloc(a), shards(nullptr), shard_bits(0) {
+  while ((size_type{1} << shard_bits) < shard_count)
+    ++shard_bits;
+  size_type count = size_type{1} << shard_bits;
+  shards = shard_traits::allocate(alloc, count);
+  size_type i{0};
+  try {
+    for (; i < count; ++i)
+      shard_traits::construct(alloc, shards + i, hash, equal, a);
+  } catch (...) {
+    while (i-- > 0)
+      shard_traits::destroy(alloc, shards + i);
+    shard_traits::deallocate(alloc, shards, count);
+    throw;
+  }
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+ConcurrentADS_set<Key, N, Allocator, Hash, KeyEqual>::~ConcurrentADS_set() {
+  size_type count = shard_count();
+  for (size_type i{0}; i < count; ++i)
+    shard_traits::destroy(alloc, shards + i);
+  shard_traits::deallocate(alloc, shards, count);
+}
+
+//////////   SIZE   ////////////////////   SIZE   //////////
+
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+typename ConcurrentADS_set<Key, N, Allocator, Hash, KeyEqual>::size_type
+ConcurrentADS_set<Key, N, Allocator, Hash, KeyEqual>::size() const {
+  size_type total{0};
+  for (size_type i{0}; i < shard_count(); ++i) {
+    std::shared_lock<std::shared_mutex> guard(shards[i].lock);
+    total += shards[i].set.size();
+  }
+  return total;
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void ConcurrentADS_set<Key, N, Allocator, Hash, KeyEqual>::reserve(
+    size_type n) {
+  size_type per_shard = n / shard_count();
+  per_shard += per_shard / 8;
+  for (size_type i{0}; i < shard_count(); ++i) {
+    std::unique_lock<std::shared_mutex> guard(shards[i].lock);
+    shards[i].set.reserve(per_shard);
+  }
+}
+
+//////////   INSERT & REMOVE   //////////
+
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+bool ConcurrentADS_set<Key, N, Allocator, Hash, KeyEqual>::insert(
+    const key_type &key) {
+  size_type hash = this->hash(key);
+  Shard &target = shard(hash);
+  std::unique_lock<std::shared_mutex> guard(target.lock);
+  return target.set.insert_hashed(key, hash).second;
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+bool ConcurrentADS_set<Key, N, Allocator, Hash, KeyEqual>::insert(
+    key_type &&key) {
+  size_type hash = this->hash(key);
+  Shard &target = shard(hash);
+  std::unique_lock<std::shared_mutex> guard(target.lock);
+  return target.set.insert_hashed(std::move(key), hash).second;
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void ConcurrentADS_set<Key, N, Allocator, Hash, KeyEqual>::insert(
+    std::initializer_list<key_type> ilist) {
+  insert(ilist.begin(), ilist.end());
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+template <typename InputIt>
+void ConcurrentADS_set<Key, N, Allocator, Hash, KeyEqual>::insert(
+    InputIt first, InputIt last) {
+  for (; first != last; ++first)
+    insert(*first);
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+typename ConcurrentADS_set<Key, N, Allocator, Hash, KeyEqual>::size_type
+ConcurrentADS_set<Key, N, Allocator, Hash, KeyEqual>::erase(
+    const key_type &key) {
+  size_type hash = this->hash(key);
+  Shard &target = shard(hash);
+  std::unique_lock<std::shared_mutex> guard(target.lock);
+  return target.set.erase_hashed(key, hash);
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void ConcurrentADS_set<Key, N, Allocator, Hash, KeyEqual>::clear() {
+  for (size_type i{0}; i < shard_count(); ++i) {
+    std::unique_lock<std::shared_mutex> guard(shards[i].lock);
+    shards[i].set.clear();
+  }
+}
+
+//////////   SEARCH   ////////////////////   SEARCH   //////////
+
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+typename ConcurrentADS_set<Key, N, Allocator, Hash, KeyEqual>::size_type
+ConcurrentADS_set<Key, N, Allocator, Hash, KeyEqual>::count(
+    const key_type &key) const {
+  size_type hash = this->hash(key);
+  Shard &target = shard(hash);
+  std::shared_lock<std::shared_mutex> guard(target.lock);
+  return target.set.count_hashed(key, hash);
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+template <typename F>
+void ConcurrentADS_set<Key, N, Allocator, Hash, KeyEqual>::for_each(F f) const {
+  for (size_type i{0}; i < shard_count(); ++i) {
+    std::shared_lock<std::shared_mutex> guard(shards[i].lock);
+    for (const key_type &key : shards[i].set)
+      f(key);
+  }
+}
+
+#endif // CONCURRENT_ADS_SET_H
@@ -0,0 +1,484 @@
+#ifndef DEDUP_ADS_SET_H
+#define DEDUP_ADS_SET_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "ADS_concurrent.h"
+
+// Insert-only extendible hashing for deduplication from many threads, with
+// no mutex anywhere. Lookups never wait. Inserts can: a slot is claimed
+// before it is written, and an insert into the same bucket, or a split of
+// it, waits until the claimant publishes. A claimant descheduled in between
+// stalls them, so inserts are blocking, not lock-free.
+//
+// A bucket's state word holds its claimed slot count plus a FROZEN bit. An
+// inserter claims the next slot with a CAS on it, writes the key, then
+// compares it against every lower slot, waiting for those to be
+// published. It publishes its own slot with a release store as live, or as
+// dead when a lower slot already holds the key, so among concurrent inserts
+// of one key the lowest slot wins.
+//
+// A full bucket gets FROZEN, and whoever meets it helps split it: wait for
+// the claimed slots, copy the live ones into two fresh children and CAS the
+// pair into the bucket's forward pointer. Losers drop their copies. The
+// forward pointer is what lookups follow; the directory only says where to
+// start and is repaired as lookups find it stale. Old directories and split
+// buckets stay allocated until the set is destroyed, which roughly doubles
+// the footprint in exchange for no reclamation at all.
+template <typename Key, size_t N = 63, typename Allocator = std::allocator<Key>,
+          typename Hash = std::hash<Key>,
+          typename KeyEqual = std::equal_to<Key>>
+class DedupADS_set {
+public:
+  using value_type = Key;
+  using key_type = Key;
+  using size_type = size_t;
+  using key_equal = KeyEqual;
+  using hasher = Hash;
+  using allocator_type = Allocator;
+
+private:
+  //////////   BUCKET   //////////
+  static constexpr std::uint64_t frozen = std::uint64_t{1} << 63;
+  // a published slot's mark is dead, or live plus 7 bits of mixed hash so
+  // scans compare one byte per slot before touching keys
+  enum : std::uint8_t { claimed = 0, dead = 1, live = 0x80 };
+  static std::uint8_t mark_of(size_type hash) {
+    std::uint64_t mixed =
+        static_cast<std::uint64_t>(hash) * 0x9E3779B97F4A7C15ull;
+    return static_cast<std::uint8_t>(live | (mixed >> 57));
+  }
+  // 0x80 in every byte of word that is zero, without borrows between bytes
+  static std::uint64_t zero_bytes(std::uint64_t word) {
+    constexpr std::uint64_t low7 = 0x7F7F7F7F7F7F7F7Full;
+    return ~(((word & low7) + low7) | word | low7);
+  }
+  struct alignas(64) Bucket {
+    std::atomic<std::uint64_t> state{0}; // claimed slots | frozen
+    std::atomic<Bucket *> forward{nullptr}; // both children once split
+    size_type local_depth{0};
+    // eight marks per word, so a scan reads them a word at a time
+    std::atomic<std::uint64_t> marks[(N + 7) / 8]{};
+    key_type elements[N];
+    bool holds(size_type at, const key_type &key,
+               const key_equal &equal) const {
+      return equal(elements[at], key);
+    }
+    std::uint8_t mark(size_type i) const {
+      std::uint64_t word = marks[i / 8].load(std::memory_order_acquire);
+      return static_cast<std::uint8_t>(word >> (i % 8 * 8));
+    }
+    void publish(size_type i, std::uint8_t mark,
+                 std::memory_order order = std::memory_order_release) {
+      marks[i / 8].fetch_or(std::uint64_t{mark} << (i % 8 * 8), order);
+    }
+    // published mark of slot i, waiting out the claimant's few stores;
+    // yields so a claimant that got descheduled can finish them
+    std::uint8_t published(size_type i) const {
+      std::uint8_t found;
+      for (unsigned spins{0}; (found = mark(i)) == claimed; ++spins) {
+        if (spins >= 64)
+          std::this_thread::yield();
+      }
+      return found;
+    }
+    // whether a published slot below end holds key; pending is set to the
+    // first slot below end still claimed, or end
+    bool find(const key_type &key, std::uint8_t expected, size_type end,
+              size_type &pending, const key_equal &equal) const {
+      pending = end;
+      for (size_type base{0}; base < end; base += 8) {
+        std::uint64_t word = marks[base / 8].load(std::memory_order_acquire);
+        std::uint64_t in_range = ~std::uint64_t{0};
+        if (end - base < 8)
+          in_range = (std::uint64_t{1} << ((end - base) * 8)) - 1;
+        std::uint64_t open = zero_bytes(word) & in_range;
+        if (open && pending == end)
+          pending = base + static_cast<size_type>(__builtin_ctzll(open)) / 8;
+        std::uint64_t hits =
+            zero_bytes(word ^ (0x0101010101010101ull * expected)) & in_range;
+        for (; hits; hits &= hits - 1) {
+          if (holds(base + static_cast<size_type>(__builtin_ctzll(hits)) / 8,
+                    key, equal))
+            return true;
+        }
+      }
+      return false;
+    }
+  };
+  using Slot = std::atomic<Bucket *>;
+  struct Table {
+    size_type global_depth;
+    Slot *slots;
+    Table *older; // kept until destruction, readers may still be on it
+  };
+  template <typename T>
+  using rebind =
+      typename std::allocator_traits<Allocator>::template rebind_alloc<T>;
+  using bucket_traits = std::allocator_traits<rebind<Bucket>>;
+  using slot_traits = std::allocator_traits<rebind<Slot>>;
+  using table_traits = std::allocator_traits<rebind<Table>>;
+  using bucket_list = std::vector<Bucket *, rebind<Bucket *>>;
+
+  //////////   INSTANZ VARS   //////////
+  MixedHash<hasher> hashing;
+  key_equal equal;
+  rebind<Bucket> bucket_alloc;
+  rebind<Slot> slot_alloc;
+  rebind<Table> table_alloc;
+  Bucket *roots; // the two depth 1 buckets everything splits from
+  std::atomic<Table *> table;
+
+  // buckets come in pairs: the roots and every split's children
+  Bucket *make_pair(size_type depth);
+  void drop_pair(Bucket *pair);
+  Table *make_table(size_type depth, Table *older);
+  void drop_table(Table *t);
+  // leaf bucket for hash, repairing the directory slot if it was stale
+  Bucket *find_bucket(size_type hash) const;
+  // child of the frozen bucket that hash goes to, splitting it if needed
+  Bucket *help_split(Bucket *bucket, size_type hash);
+  // points the directory at the children of a finished split
+  void update_hints(Bucket *bucket, Bucket *children, size_type hash);
+  // f(bucket) for every leaf bucket
+  template <typename F> void each_leaf(F f) const;
+
+public:
+  explicit DedupADS_set(const allocator_type &alloc = allocator_type());
+  // for stateful (e.g. seeded) hashers; the copies are kept in the set
+  DedupADS_set(const hasher &hash, const key_equal &equal = key_equal(),
+               const allocator_type &alloc = allocator_type());
+  DedupADS_set(std::initializer_list<key_type> ilist);
+  DedupADS_set(const DedupADS_set &) = delete;
+  DedupADS_set &operator=(const DedupADS_set &) = delete;
+  ~DedupADS_set();
+
+  // true if key was not in the set yet; may wait on other inserters into
+  // the same bucket, see above
+  bool insert(const key_type &key);
+  void insert(std::initializer_list<key_type> ilist);
+  template <typename InputIt> void insert(InputIt first, InputIt last);
+  size_type count(const key_type &key) const;
+  bool contains(const key_type &key) const { return count(key) != 0; }
+  // size() and for_each() walk every bucket; under concurrent inserts they
+  // see each key published before they reach its bucket
+  size_type size() const;
+  bool empty() const { return size() == 0; }
+  template <typename F> void for_each(F f) const;
+  hasher hash_function() const { return hashing.function(); }
+  key_equal key_eq() const { return equal; }
+};
+
+//////////   HELPERS   ////////////////////   HELPERS   //////////
+
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+typename DedupADS_set<Key, N, Allocator, Hash, KeyEqual>::Bucket *
+DedupADS_set<Key, N, Allocator, Hash, KeyEqual>::make_pair(size_type depth) {
+  Bucket *pair = bucket_traits::allocate(bucket_alloc, 2);
+  size_type i{0};
+  try {
+    for (; i < 2; ++i) {
+      bucket_traits::construct(bucket_alloc, pair + i);
+      pair[i].local_depth = depth;
+    }
+  } catch (...) {
+    while (i-- > 0)
+      bucket_traits::destroy(bucket_alloc, pair + i);
+    bucket_traits::deallocate(bucket_alloc, pair, 2);
+    throw;
+  }
+  return pair;
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void DedupADS_set<Key, N, Allocator, Hash, KeyEqual>::drop_pair(Bucket *pair) {
+  bucket_traits::destroy(bucket_alloc, pair + 1);
+  bucket_traits::destroy(bucket_alloc, pair);
+  bucket_traits::deallocate(bucket_alloc, pair, 2);
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+typename DedupADS_set<Key, N, Allocator, Hash, KeyEqual>::Table *
+DedupADS_set<Key, N, Allocator, Hash, KeyEqual>::make_table(
+    size_type depth, Table *older) {
+  size_type size = size_type{1} << depth;
+  Table *t = table_traits::allocate(table_alloc, 1);
+  try {
+    t->slots = slot_traits::allocate(slot_alloc, size);
+  } catch (...) {
+    table_traits::deallocate(table_alloc, t, 1);
+    throw;
+  }
+  t->global_depth = depth;
+  t->older = older;
+  // a new directory starts as older's slots repeated
+  size_type mask = older ? (size_type{1} << older->global_depth) - 1 : 1;
+  for (size_type i{0}; i < size; ++i) {
+    Bucket *start = roots + (i & mask);
+    if (older)
+      start = older->slots[i & mask].load(std::memory_order_acquire);
+    slot_traits::construct(slot_alloc, t->slots + i, start);
+  }
+  return t;
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void DedupADS_set<Key, N, Allocator, Hash, KeyEqual>::drop_table(Table *t) {
+  size_type size = size_type{1} << t->global_depth;
+  for (size_type i{0}; i < size; ++i)
+    slot_traits::destroy(slot_alloc, t->slots + i);
+  slot_traits::deallocate(slot_alloc, t->slots, size);
+  table_traits::deallocate(table_alloc, t, 1);
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+typename DedupADS_set<Key, N, Allocator, Hash, KeyEqual>::Bucket *
+DedupADS_set<Key, N, Allocator, Hash, KeyEqual>::find_bucket(
+    size_type hash) const {
+  Table *t = table.load(std::memory_order_acquire);
+  Slot &slot = t->slots[hash & ((size_type{1} << t->global_depth) - 1)];
+  Bucket *start = slot.load(std::memory_order_acquire);
+  Bucket *bucket = start, *fits = start;
+  while (Bucket *children = bucket->forward.load(std::memory_order_acquire)) {
+    bucket = children + ((hash >> bucket->local_depth) & 1);
+    if (bucket->local_depth <= t->global_depth)
+      fits = bucket;
+  }
+  // best effort: the deepest bucket this slot can name on its own
+  if (fits != start)
+    slot.compare_exchange_strong(start, fits, std::memory_order_release,
+                                 std::memory_order_relaxed);
+  return bucket;
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+typename DedupADS_set<Key, N, Allocator, Hash, KeyEqual>::Bucket *
+DedupADS_set<Key, N, Allocator, Hash, KeyEqual>::help_split(
+    Bucket *bucket, size_type hash) {
+  size_type bit = bucket->local_depth;
+  Bucket *children = bucket->forward.load(std::memory_order_acquire);
+  if (!children) {
+    Bucket *built = make_pair(bit + 1);
+    try {
+      size_type counts[2] = {0, 0};
+      for (size_type i{0}; i < N; ++i) {
+        std::uint8_t mark = bucket->published(i);
+        if (!(mark & live))
+          continue;
+        size_type side = (hashing(bucket->elements[i]) >> bit) & 1;
+        Bucket &to = built[side];
+        to.elements[counts[side]] = bucket->elements[i];
+        to.publish(counts[side]++, mark, std::memory_order_relaxed);
+      }
+      built[0].state.store(counts[0], std::memory_order_relaxed);
+      built[1].state.store(counts[1], std::memory_order_relaxed);
+    } catch (...) {
+      drop_pair(built);
+      throw;
+    }
+    if (bucket->forward.compare_exchange_strong(children, built,
+                                                std::memory_order_acq_rel,
+                                                std::memory_order_acquire)) {
+      children = built;
+      update_hints(bucket, children, hash);
+    } else {
+      drop_pair(built); // never seen by anyone else
+    }
+  }
+  return children + ((hash >> bit) & 1);
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void DedupADS_set<Key, N, Allocator, Hash, KeyEqual>::update_hints(
+    Bucket *bucket, Bucket *children, size_type hash) {
+  size_type depth = bucket->local_depth + 1;
+  Table *t = table.load(std::memory_order_acquire);
+  while (t->global_depth < depth) {
+    Table *doubled = make_table(t->global_depth + 1, t);
+    if (table.compare_exchange_strong(t, doubled, std::memory_order_acq_rel,
+                                      std::memory_order_acquire))
+      t = doubled;
+    else
+      drop_table(doubled);
+  }
+  size_type mask = size_type{1} << bucket->local_depth;
+  size_type size = size_type{1} << t->global_depth;
+  // no CAS: losing a race to a deeper split only leaves a stale hint, which
+  // find_bucket() follows and repairs
+  for (size_type i = hash & (mask - 1); i < size; i += mask) {
+    if (t->slots[i].load(std::memory_order_relaxed) == bucket)
+      t->slots[i].store(children + ((i & mask) != 0),
+                        std::memory_order_release);
+  }
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+template <typename F>
+void DedupADS_set<Key, N, Allocator, Hash, KeyEqual>::each_leaf(F f) const {
+  bucket_list pending{rebind<Bucket *>(bucket_alloc)};
+  pending.push_back(roots);
+  pending.push_back(roots + 1);
+  while (!pending.empty()) {
+    Bucket *bucket = pending.back();
+    pending.pop_back();
+    if (Bucket *children = bucket->forward.load(std::memory_order_acquire)) {
+      pending.push_back(children);
+      pending.push_back(children + 1);
+    } else {
+      f(bucket);
+    }
+  }
+}
+
+//////////   CONSTR   ////////////////////   CONSTR   //////////
+
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+DedupADS_set<Key, N, Allocator, Hash, KeyEqual>::DedupADS_set(
+    const allocator_type &alloc)
+    : DedupADS_set(hasher(), key_equal(), alloc) {}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+DedupADS_set<Key, N, Allocator, Hash, KeyEqual>::DedupADS_set(
+    const hasher &hash, const key_equal &equal, const allocator_type &alloc)
+    : hashing(hash), equal(equal), bucket_alloc(alloc), slot_alloc(alloc),
+      table_alloc(alloc), roots(make_pair(1)) {
+  try {
+    table.store(make_table(1, nullptr), std::memory_order_relaxed);
+  } catch (...) {
+    drop_pair(roots);
+    throw;
+  }
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+DedupADS_set<Key, N, Allocator, Hash, KeyEqual>::DedupADS_set(
+    std::initializer_list<key_type> ilist)
+    : DedupADS_set() {
+  insert(ilist);
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+DedupADS_set<Key, N, Allocator, Hash, KeyEqual>::~DedupADS_set() {
+  bucket_list pairs{rebind<Bucket *>(bucket_alloc)};
+  pairs.push_back(roots);
+  for (size_type i{0}; i < pairs.size(); ++i) {
+    for (Bucket *bucket = pairs[i]; bucket != pairs[i] + 2; ++bucket) {
+      if (Bucket *children = bucket->forward.load(std::memory_order_relaxed))
+        pairs.push_back(children);
+    }
+  }
+  for (Bucket *pair : pairs)
+    drop_pair(pair);
+  for (Table *t = table.load(std::memory_order_relaxed); t;) {
+    Table *older = t->older;
+    drop_table(t);
+    t = older;
+  }
+}
+
+//////////   INSERT   ////////////////////   INSERT   //////////
+
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+bool DedupADS_set<Key, N, Allocator, Hash, KeyEqual>::insert(
+    const key_type &key) {
+  size_type hash = hashing(key);
+  std::uint8_t expected = mark_of(hash);
+  Bucket *bucket = find_bucket(hash);
+  for (;;) {
+    std::uint64_t state = bucket->state.load(std::memory_order_acquire);
+    if (state & frozen) {
+      bucket = help_split(bucket, hash);
+      continue;
+    }
+    size_type claimed_slots = static_cast<size_type>(state);
+    // early out on what is already published; only slots still pending
+    // here need a second look once we own a slot
+    size_type pending;
+    if (bucket->find(key, expected, claimed_slots, pending, equal))
+      return false;
+    if (claimed_slots == N) {
+      bucket->state.compare_exchange_strong(state, state | frozen,
+                                            std::memory_order_acq_rel);
+      continue;
+    }
+    if (!bucket->state.compare_exchange_weak(state, state + 1,
+                                             std::memory_order_acq_rel))
+      continue;
+    size_type at = claimed_slots;
+    bool duplicate = false;
+    try {
+      bucket->elements[at] = key;
+      for (size_type i = pending; i < at && !duplicate; ++i)
+        duplicate =
+            bucket->published(i) == expected && bucket->holds(i, key, equal);
+    } catch (...) {
+      bucket->publish(at, dead);
+      throw;
+    }
+    bucket->publish(at, duplicate ? std::uint8_t{dead} : expected);
+    return !duplicate;
+  }
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void DedupADS_set<Key, N, Allocator, Hash, KeyEqual>::insert(
+    std::initializer_list<key_type> ilist) {
+  insert(ilist.begin(), ilist.end());
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+template <typename InputIt>
+void DedupADS_set<Key, N, Allocator, Hash, KeyEqual>::insert(
+    InputIt first, InputIt last) {
+  for (; first != last; ++first)
+    insert(*first);
+}
+
+//////////   SEARCH   ////////////////////   SEARCH   //////////
+
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+typename DedupADS_set<Key, N, Allocator, Hash, KeyEqual>::size_type
+DedupADS_set<Key, N, Allocator, Hash, KeyEqual>::count(
+    const key_type &key) const {
+  size_type hash = hashing(key);
+  std::uint8_t expected = mark_of(hash);
+  const Bucket *bucket = find_bucket(hash);
+  size_type claimed_slots = static_cast<size_type>(
+      bucket->state.load(std::memory_order_acquire) & ~frozen);
+  size_type pending;
+  return bucket->find(key, expected, claimed_slots, pending, equal) ? 1 : 0;
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+typename DedupADS_set<Key, N, Allocator, Hash, KeyEqual>::size_type
+DedupADS_set<Key, N, Allocator, Hash, KeyEqual>::size() const {
+  size_type total{0};
+  each_leaf([&total](const Bucket *bucket) {
+    for (size_type i{0}; i < N; ++i)
+      total += (bucket->mark(i) & live) != 0;
+  });
+  return total;
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+template <typename F>
+void DedupADS_set<Key, N, Allocator, Hash, KeyEqual>::for_each(F f) const {
+  each_leaf([&f](const Bucket *bucket) {
+    for (size_type i{0}; i < N; ++i) {
+      if (bucket->mark(i) & live)
+        f(bucket->elements[i]);
+    }
+  });
+}
+
+#endif // DEDUP_ADS_SET_H
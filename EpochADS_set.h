@@ -0,0 +1,297 @@
+#ifndef EPOCH_ADS_SET_H
+#define EPOCH_ADS_SET_H
+
+#include <atomic>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+
+#include "ADS_concurrent.h"
+
+// Extendible hashing for read-mostly workloads: lookups take no lock and
+// write only their thread's EpochDomain record, writers serialize on one
+// mutex.
+//
+// Readers never see a bucket change under them except for appends: insert
+// copies the key into the slot past count and then publishes count with a
+// release store. Erase and split build new buckets, repoint the directory
+// slots and retire the old bucket; doubling builds a new directory and swaps
+// the directory pointer. Retired buckets and directories are freed through
+// epoch-based reclamation once no reader can still hold them.
+// Buckets do not merge.
+template <typename Key, size_t N = 63, typename Allocator = std::allocator<Key>,
+          typename Hash = std::hash<Key>,
+          typename KeyEqual = std::equal_to<Key>>
+class EpochADS_set {
+public:
+  using value_type = Key;
+  using key_type = Key;
+  using size_type = size_t;
+  using key_equal = KeyEqual;
+  using hasher = Hash;
+  using allocator_type = Allocator;
+
+private:
+  //////////   BUCKET   //////////
+  struct alignas(64) Bucket {
+    size_type local_depth;
+    std::atomic<size_type> count{0};
+    key_type elements[N];
+    explicit Bucket(size_type depth) : local_depth(depth) {}
+    // slot holding key among the first n, or n
+    size_type locate(const key_type &key, size_type n,
+                     const key_equal &equal) const {
+      for (size_type i{0}; i < n; ++i) {
+        if (equal(elements[i], key))
+          return i;
+      }
+      return n;
+    }
+  };
+  using Tables = EpochTables<Bucket, Allocator>;
+  using Table = typename Tables::Table;
+
+  //////////   INSTANZ VARS   //////////
+  MixedHash<hasher> hashing;
+  key_equal equal;
+  Tables tables;
+  std::atomic<Table *> current;
+  std::atomic<size_type> current_size{0};
+  std::mutex writer;
+
+  // the writer mutex is held for these
+  Table *double_catalog(Table *table);
+  void split_bucket(Table *table, Bucket *bucket, size_type hash);
+
+public:
+  explicit EpochADS_set(const allocator_type &alloc = allocator_type());
+  // for stateful (e.g. seeded) hashers; the copies are kept in the set
+  EpochADS_set(const hasher &hash, const key_equal &equal = key_equal(),
+               const allocator_type &alloc = allocator_type());
+  EpochADS_set(std::initializer_list<key_type> ilist);
+  EpochADS_set(const EpochADS_set &) = delete;
+  EpochADS_set &operator=(const EpochADS_set &) = delete;
+  ~EpochADS_set();
+
+  size_type size() const {
+    return current_size.load(std::memory_order_relaxed);
+  }
+  bool empty() const { return size() == 0; }
+  bool insert(const key_type &key);
+  void insert(std::initializer_list<key_type> ilist);
+  template <typename InputIt> void insert(InputIt first, InputIt last);
+  size_type erase(const key_type &key);
+  void clear();
+  // wait-free once the calling thread holds its EpochDomain record
+  size_type count(const key_type &key) const;
+  bool contains(const key_type &key) const { return count(key) != 0; }
+  // holds the writer mutex; f must not modify this set
+  template <typename F> void for_each(F f);
+  hasher hash_function() const { return hashing.function(); }
+  key_equal key_eq() const { return equal; }
+};
+
+//////////   HELPERS   ////////////////////   HELPERS   //////////
+
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+typename EpochADS_set<Key, N, Allocator, Hash, KeyEqual>::Table *
+EpochADS_set<Key, N, Allocator, Hash, KeyEqual>::double_catalog(
+    Table *table) {
+  size_type size = size_type{1} << table->global_depth;
+  tables.reserve(0, 1);
+  Table *doubled = tables.make_table(table->global_depth + 1);
+  for (size_type i{0}; i < size; ++i) {
+    Bucket *bucket = table->slots[i].load(std::memory_order_relaxed);
+    doubled->slots[i].store(bucket, std::memory_order_relaxed);
+    doubled->slots[i + size].store(bucket, std::memory_order_relaxed);
+  }
+  current.store(doubled, std::memory_order_seq_cst);
+  tables.retire(table);
+  return doubled;
+}
+// Readers may still be scanning bucket, so its keys are copied, never moved,
+// into two new buckets that then replace it slot by slot. Until the last
+// slot is stored a reader can find either, and both hold the key.
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void EpochADS_set<Key, N, Allocator, Hash, KeyEqual>::split_bucket(
+    Table *table, Bucket *bucket, size_type hash) {
+  size_type mask = size_type{1} << bucket->local_depth;
+  Bucket *low = tables.make_bucket(bucket->local_depth + 1);
+  Bucket *high = nullptr;
+  try {
+    high = tables.make_bucket(bucket->local_depth + 1);
+    size_type count = bucket->count.load(std::memory_order_relaxed);
+    for (size_type i{0}; i < count; ++i) {
+      Bucket *to = hashing(bucket->elements[i]) & mask ? high : low;
+      size_type at = to->count.load(std::memory_order_relaxed);
+      to->elements[at] = bucket->elements[i];
+      to->count.store(at + 1, std::memory_order_relaxed);
+    }
+    tables.reserve(1, 0);
+  } catch (...) {
+    tables.drop_bucket(low);
+    if (high)
+      tables.drop_bucket(high);
+    throw;
+  }
+  size_type size = size_type{1} << table->global_depth;
+  for (size_type i = hash & (mask - 1); i < size; i += mask)
+    table->slots[i].store(i & mask ? high : low, std::memory_order_seq_cst);
+  tables.retire(bucket);
+}
+
+//////////   CONSTR   ////////////////////   CONSTR   //////////
+
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+EpochADS_set<Key, N, Allocator, Hash, KeyEqual>::EpochADS_set(
+    const allocator_type &alloc)
+    : EpochADS_set(hasher(), key_equal(), alloc) {}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+EpochADS_set<Key, N, Allocator, Hash, KeyEqual>::EpochADS_set(
+    const hasher &hash, const key_equal &equal, const allocator_type &alloc)
+    : hashing(hash), equal(equal), tables(alloc) {
+  current.store(tables.make_root(), std::memory_order_relaxed);
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+EpochADS_set<Key, N, Allocator, Hash, KeyEqual>::EpochADS_set(
+    std::initializer_list<key_type> ilist)
+    : EpochADS_set() {
+  insert(ilist);
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+EpochADS_set<Key, N, Allocator, Hash, KeyEqual>::~EpochADS_set() {
+  tables.drop_all(current.load(std::memory_order_relaxed));
+}
+
+//////////   INSERT & REMOVE   //////////
+
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+bool EpochADS_set<Key, N, Allocator, Hash, KeyEqual>::insert(
+    const key_type &key) {
+  size_type hash = hashing(key);
+  std::lock_guard<std::mutex> guard(writer);
+  Table *table = current.load(std::memory_order_relaxed);
+  for (;;) {
+    size_type mask = (size_type{1} << table->global_depth) - 1;
+    Bucket *bucket = table->slots[hash & mask].load(std::memory_order_relaxed);
+    size_type count = bucket->count.load(std::memory_order_relaxed);
+    if (bucket->locate(key, count, equal) < count)
+      return false;
+    if (count < N) {
+      // no reader looks past count, so the slot is ours until published
+      bucket->elements[count] = key;
+      bucket->count.store(count + 1, std::memory_order_release);
+      current_size.store(size() + 1, std::memory_order_relaxed);
+      return true;
+    }
+    if (bucket->local_depth == table->global_depth)
+      table = double_catalog(table);
+    split_bucket(table, bucket, hash);
+  }
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void EpochADS_set<Key, N, Allocator, Hash, KeyEqual>::insert(
+    std::initializer_list<key_type> ilist) {
+  insert(ilist.begin(), ilist.end());
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+template <typename InputIt>
+void EpochADS_set<Key, N, Allocator, Hash, KeyEqual>::insert(InputIt first,
+                                                             InputIt last) {
+  for (; first != last; ++first)
+    insert(*first);
+}
+// copies the bucket without the key and swaps the copy in
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+typename EpochADS_set<Key, N, Allocator, Hash, KeyEqual>::size_type
+EpochADS_set<Key, N, Allocator, Hash, KeyEqual>::erase(const key_type &key) {
+  size_type hash = hashing(key);
+  std::lock_guard<std::mutex> guard(writer);
+  Table *table = current.load(std::memory_order_relaxed);
+  Bucket *bucket =
+      table->slots[hash & ((size_type{1} << table->global_depth) - 1)].load(
+          std::memory_order_relaxed);
+  size_type count = bucket->count.load(std::memory_order_relaxed);
+  size_type at = bucket->locate(key, count, equal);
+  if (at == count)
+    return 0;
+  Bucket *copy = tables.make_bucket(bucket->local_depth);
+  try {
+    size_type kept{0};
+    for (size_type i{0}; i < count; ++i) {
+      if (i != at)
+        copy->elements[kept++] = bucket->elements[i];
+    }
+    copy->count.store(kept, std::memory_order_relaxed);
+    tables.reserve(1, 0);
+  } catch (...) {
+    tables.drop_bucket(copy);
+    throw;
+  }
+  size_type mask = size_type{1} << bucket->local_depth;
+  size_type slots = size_type{1} << table->global_depth;
+  for (size_type i = hash & (mask - 1); i < slots; i += mask)
+    table->slots[i].store(copy, std::memory_order_seq_cst);
+  current_size.store(size() - 1, std::memory_order_relaxed);
+  tables.retire(bucket);
+  return 1;
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void EpochADS_set<Key, N, Allocator, Hash, KeyEqual>::clear() {
+  std::lock_guard<std::mutex> guard(writer);
+  Table *table = current.load(std::memory_order_relaxed);
+  Table *fresh = tables.make_root();
+  try {
+    tables.reserve(size_type{1} << table->global_depth, 1);
+  } catch (...) {
+    tables.drop_all(fresh);
+    throw;
+  }
+  current.store(fresh, std::memory_order_seq_cst);
+  current_size.store(0, std::memory_order_relaxed);
+  tables.retire_all(table);
+}
+
+//////////   SEARCH   ////////////////////   SEARCH   //////////
+
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+typename EpochADS_set<Key, N, Allocator, Hash, KeyEqual>::size_type
+EpochADS_set<Key, N, Allocator, Hash, KeyEqual>::count(
+    const key_type &key) const {
+  size_type hash = hashing(key);
+  EpochDomain::ReadGuard guard(tables.domain());
+  const Table *table = current.load(std::memory_order_seq_cst);
+  const Bucket *bucket =
+      table->slots[hash & ((size_type{1} << table->global_depth) - 1)].load(
+          std::memory_order_seq_cst);
+  size_type count = bucket->count.load(std::memory_order_acquire);
+  return bucket->locate(key, count, equal) < count ? 1 : 0;
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+template <typename F>
+void EpochADS_set<Key, N, Allocator, Hash, KeyEqual>::for_each(F f) {
+  std::lock_guard<std::mutex> guard(writer);
+  Tables::each_bucket(current.load(std::memory_order_relaxed),
+                      [&f](Bucket *bucket) {
+                        size_type count =
+                            bucket->count.load(std::memory_order_relaxed);
+                        for (size_type i{0}; i < count; ++i)
+                          f(static_cast<const key_type &>(bucket->elements[i]));
+                      });
+}
+
+#endif // EPOCH_ADS_SET_H
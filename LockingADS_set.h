@@ -0,0 +1,290 @@
+#ifndef LOCKING_ADS_SET_H
+#define LOCKING_ADS_SET_H
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+
+#include "ADS_concurrent.h"
+
+// Extendible hashing with Ellis-style fine-grained locking. Every operation
+// holds the directory lock shared plus the lock of its bucket; a split needs
+// nothing more, since the slots it repoints are the bucket's own aliases.
+// Only doubling the directory takes the directory lock exclusively.
+//
+// Directory slots are atomics: a split stores them while other threads load
+// theirs. A thread that found a bucket re-reads its slot after locking it
+// and retries if a split moved the key's slot on in the meantime.
+//
+// Buckets never merge, so no bucket is freed while the set is alive.
+template <typename Key, size_t N = 63, typename Allocator = std::allocator<Key>,
+          typename Hash = std::hash<Key>,
+          typename KeyEqual = std::equal_to<Key>>
+class LockingADS_set {
+public:
+  using value_type = Key;
+  using key_type = Key;
+  using size_type = size_t;
+  using key_equal = KeyEqual;
+  using hasher = Hash;
+  using allocator_type = Allocator;
+
+private:
+  //////////   BUCKET   //////////
+  struct alignas(64) Bucket {
+    mutable std::shared_mutex lock;
+    size_type local_depth;
+    size_type count{0};
+    key_type elements[N];
+    explicit Bucket(size_type depth) : local_depth(depth) {}
+    // slot holding key, or count if it is not in this bucket
+    size_type locate(const key_type &key, const key_equal &equal) const {
+      for (size_type i{0}; i < count; ++i) {
+        if (equal(elements[i], key))
+          return i;
+      }
+      return count;
+    }
+  };
+  using Tables = BucketTables<Bucket, Allocator>;
+  using Table = typename Tables::Table;
+
+  //////////   INSTANZ VARS   //////////
+  mutable std::shared_mutex directory_lock;
+  MixedHash<hasher> hashing;
+  key_equal equal;
+  Tables tables;
+  // changes only under directory_lock held exclusively
+  Table *table;
+
+  // the bucket for hash, locked by guard once it is still the one its slot
+  // points at; directory_lock held shared
+  template <typename Guard>
+  Bucket *lock_bucket(size_type hash, Guard &guard) const;
+  // bucket's lock held exclusive, its local depth below global_depth
+  void split_bucket(Bucket *bucket, size_type hash);
+  // doubles the directory unless another thread did since depth was read
+  void double_catalog(size_type depth);
+
+public:
+  explicit LockingADS_set(const allocator_type &alloc = allocator_type());
+  // for stateful (e.g. seeded) hashers; the copies are kept in the set
+  LockingADS_set(const hasher &hash, const key_equal &equal = key_equal(),
+                 const allocator_type &alloc = allocator_type());
+  LockingADS_set(std::initializer_list<key_type> ilist);
+  LockingADS_set(const LockingADS_set &) = delete;
+  LockingADS_set &operator=(const LockingADS_set &) = delete;
+  ~LockingADS_set();
+
+  // size(), clear() and for_each() take the directory lock exclusively
+  size_type size() const;
+  bool empty() const { return size() == 0; }
+  bool insert(const key_type &key);
+  void insert(std::initializer_list<key_type> ilist);
+  template <typename InputIt> void insert(InputIt first, InputIt last);
+  size_type erase(const key_type &key);
+  void clear();
+  size_type count(const key_type &key) const;
+  bool contains(const key_type &key) const { return count(key) != 0; }
+  // f must not call back into this set
+  template <typename F> void for_each(F f) const;
+  hasher hash_function() const { return hashing.function(); }
+  key_equal key_eq() const { return equal; }
+};
+
+//////////   HELPERS   ////////////////////   HELPERS   //////////
+
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+template <typename Guard>
+typename LockingADS_set<Key, N, Allocator, Hash, KeyEqual>::Bucket *
+LockingADS_set<Key, N, Allocator, Hash, KeyEqual>::lock_bucket(
+    size_type hash, Guard &guard) const {
+  typename Tables::Slot &slot =
+      table->slots[hash & ((size_type{1} << table->global_depth) - 1)];
+  for (;;) {
+    Bucket *bucket = slot.load(std::memory_order_acquire);
+    guard = Guard(bucket->lock);
+    // a split repoints slots while it holds the bucket lock, so this load
+    // sees every store made before we got the lock
+    if (slot.load(std::memory_order_relaxed) == bucket)
+      return bucket;
+    guard.unlock();
+  }
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void LockingADS_set<Key, N, Allocator, Hash, KeyEqual>::split_bucket(
+    Bucket *bucket, size_type hash) {
+  size_type mask = size_type{1} << bucket->local_depth;
+  Bucket *sibling = tables.make_bucket(bucket->local_depth + 1);
+  size_type old_count = bucket->count;
+  bucket->count = 0;
+  for (size_type i{0}; i < old_count; ++i) {
+    if ((hashing(bucket->elements[i]) & mask) == 0) {
+      if (bucket->count != i)
+        bucket->elements[bucket->count] = std::move(bucket->elements[i]);
+      ++bucket->count;
+    } else {
+      sibling->elements[sibling->count++] = std::move(bucket->elements[i]);
+    }
+  }
+  ++bucket->local_depth;
+  // the sibling stays locked until all of its slots point at it, so nobody
+  // splits it while its aliases are half published
+  std::unique_lock<std::shared_mutex> guard(sibling->lock);
+  size_type size = size_type{1} << table->global_depth;
+  for (size_type i = (hash & (mask - 1)) | mask; i < size; i += mask << 1)
+    table->slots[i].store(sibling, std::memory_order_release);
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void LockingADS_set<Key, N, Allocator, Hash, KeyEqual>::double_catalog(
+    size_type depth) {
+  std::unique_lock<std::shared_mutex> dir(directory_lock);
+  if (table->global_depth != depth)
+    return;
+  size_type size = size_type{1} << depth;
+  Table *doubled = tables.make_table(depth + 1);
+  for (size_type i{0}; i < size; ++i) {
+    Bucket *bucket = table->slots[i].load(std::memory_order_relaxed);
+    doubled->slots[i].store(bucket, std::memory_order_relaxed);
+    doubled->slots[i + size].store(bucket, std::memory_order_relaxed);
+  }
+  tables.drop_table(table);
+  table = doubled;
+}
+
+//////////   CONSTR   ////////////////////   CONSTR   //////////
+
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+LockingADS_set<Key, N, Allocator, Hash, KeyEqual>::LockingADS_set(
+    const allocator_type &alloc)
+    : LockingADS_set(hasher(), key_equal(), alloc) {}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+LockingADS_set<Key, N, Allocator, Hash, KeyEqual>::LockingADS_set(
+    const hasher &hash, const key_equal &equal, const allocator_type &alloc)
+    : hashing(hash), equal(equal), tables(alloc),
+      table(tables.make_root()) {}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+LockingADS_set<Key, N, Allocator, Hash, KeyEqual>::LockingADS_set(
+    std::initializer_list<key_type> ilist)
+    : LockingADS_set() {
+  insert(ilist);
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+LockingADS_set<Key, N, Allocator, Hash, KeyEqual>::~LockingADS_set() {
+  tables.drop_all(table);
+}
+
+//////////   INSERT & REMOVE   //////////
+
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+bool LockingADS_set<Key, N, Allocator, Hash, KeyEqual>::insert(
+    const key_type &key) {
+  size_type hash = hashing(key);
+  for (;;) {
+    size_type depth;
+    {
+      std::shared_lock<std::shared_mutex> dir(directory_lock);
+      std::unique_lock<std::shared_mutex> guard;
+      Bucket *bucket = lock_bucket(hash, guard);
+      if (bucket->locate(key, equal) < bucket->count)
+        return false;
+      if (bucket->count < N) {
+        bucket->elements[bucket->count++] = key;
+        return true;
+      }
+      depth = table->global_depth;
+      if (bucket->local_depth < depth) {
+        split_bucket(bucket, hash);
+        continue;
+      }
+    }
+    double_catalog(depth);
+  }
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void LockingADS_set<Key, N, Allocator, Hash, KeyEqual>::insert(
+    std::initializer_list<key_type> ilist) {
+  insert(ilist.begin(), ilist.end());
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+template <typename InputIt>
+void LockingADS_set<Key, N, Allocator, Hash, KeyEqual>::insert(
+    InputIt first, InputIt last) {
+  for (; first != last; ++first)
+    insert(*first);
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+typename LockingADS_set<Key, N, Allocator, Hash, KeyEqual>::size_type
+LockingADS_set<Key, N, Allocator, Hash, KeyEqual>::erase(
+    const key_type &key) {
+  size_type hash = hashing(key);
+  std::shared_lock<std::shared_mutex> dir(directory_lock);
+  std::unique_lock<std::shared_mutex> guard;
+  Bucket *bucket = lock_bucket(hash, guard);
+  size_type at = bucket->locate(key, equal);
+  if (at == bucket->count)
+    return 0;
+  if (at + 1 < bucket->count)
+    bucket->elements[at] = std::move(bucket->elements[bucket->count - 1]);
+  --bucket->count;
+  return 1;
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void LockingADS_set<Key, N, Allocator, Hash, KeyEqual>::clear() {
+  std::unique_lock<std::shared_mutex> dir(directory_lock);
+  Table *fresh = tables.make_root();
+  tables.drop_all(table);
+  table = fresh;
+}
+
+//////////   SEARCH   ////////////////////   SEARCH   //////////
+
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+typename LockingADS_set<Key, N, Allocator, Hash, KeyEqual>::size_type
+LockingADS_set<Key, N, Allocator, Hash, KeyEqual>::count(
+    const key_type &key) const {
+  size_type hash = hashing(key);
+  std::shared_lock<std::shared_mutex> dir(directory_lock);
+  std::shared_lock<std::shared_mutex> guard;
+  Bucket *bucket = lock_bucket(hash, guard);
+  return bucket->locate(key, equal) < bucket->count ? 1 : 0;
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+typename LockingADS_set<Key, N, Allocator, Hash, KeyEqual>::size_type
+LockingADS_set<Key, N, Allocator, Hash, KeyEqual>::size() const {
+  std::unique_lock<std::shared_mutex> dir(directory_lock);
+  size_type total{0};
+  Tables::each_bucket(
+      table, [&total](const Bucket *bucket) { total += bucket->count; });
+  return total;
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+template <typename F>
+void LockingADS_set<Key, N, Allocator, Hash, KeyEqual>::for_each(F f) const {
+  std::unique_lock<std::shared_mutex> dir(directory_lock);
+  Tables::each_bucket(table, [&f](const Bucket *bucket) {
+    for (size_type i{0}; i < bucket->count; ++i)
+      f(bucket->elements[i]);
+  });
+}
+
+#endif // LOCKING_ADS_SET_H
@@ -0,0 +1,379 @@
+#ifndef SEQLOCK_ADS_SET_H
+#define SEQLOCK_ADS_SET_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <shared_mutex>
+#include <type_traits>
+#include <utility>
+
+#include "ADS_concurrent.h"
+
+// Extendible hashing where writers change buckets in place under one mutex
+// and readers validate what they saw instead of locking. Every bucket has a
+// version that is odd while a writer is inside it: insert, erase and
+// split_bucket bump it before and after they touch the bucket. A reader
+// notes the version, copies the bucket's keys out, and retries if the
+// version moved or the slot or directory it came through was replaced
+// meanwhile; only a validated copy is compared against the key. Doubling
+// publishes a new directory and retires the old one through an EpochDomain;
+// buckets are never freed while the set is alive, clear() aside, and do not
+// merge.
+//
+// Copying keys a writer is storing is only defined when they are stored as
+// atomics, so trivially copyable keys live in relaxed atomic words and are
+// copied in and out byte for byte. Other key types are stored plainly and
+// take the writer lock shared for lookups instead.
+template <typename Key, size_t N = 63, typename Allocator = std::allocator<Key>,
+          typename Hash = std::hash<Key>,
+          typename KeyEqual = std::equal_to<Key>>
+class SeqlockADS_set {
+public:
+  using value_type = Key;
+  using key_type = Key;
+  using size_type = size_t;
+  using key_equal = KeyEqual;
+  using hasher = Hash;
+  using allocator_type = Allocator;
+  // lookups validate versions rather than lock
+  static constexpr bool optimistic = std::is_trivially_copyable<Key>::value;
+
+private:
+  //////////   KEYS   //////////
+  struct PlainKeys {
+    key_type elements[N];
+    const key_type &get(size_type i) const { return elements[i]; }
+    void put(size_type i, const key_type &key) { elements[i] = key; }
+    void move(size_type to, PlainKeys &from, size_type at) {
+      elements[to] = std::move(from.elements[at]);
+    }
+  };
+  // each key as sizeof(key_type) / sizeof(word) relaxed atomic words
+  struct AtomicKeys {
+    using word = std::conditional_t<
+        sizeof(key_type) % 8 == 0, std::uint64_t,
+        std::conditional_t<sizeof(key_type) % 4 == 0, std::uint32_t,
+                           std::conditional_t<sizeof(key_type) % 2 == 0,
+                                              std::uint16_t, std::uint8_t>>>;
+    static constexpr size_type words = sizeof(key_type) / sizeof(word);
+    std::atomic<word> slots[N * words];
+    // the bytes of key i, written to raw storage for a key_type
+    void copy_out(size_type i, unsigned char *to) const {
+      for (size_type j{0}; j < words; ++j) {
+        word w = slots[i * words + j].load(std::memory_order_relaxed);
+        std::memcpy(to + j * sizeof(word), &w, sizeof(word));
+      }
+    }
+    key_type get(size_type i) const {
+      alignas(key_type) unsigned char raw[sizeof(key_type)];
+      copy_out(i, raw);
+      return *std::launder(reinterpret_cast<const key_type *>(raw));
+    }
+    void put(size_type i, const key_type &key) {
+      const unsigned char *from = reinterpret_cast<const unsigned char *>(&key);
+      for (size_type j{0}; j < words; ++j) {
+        word w;
+        std::memcpy(&w, from + j * sizeof(word), sizeof(word));
+        slots[i * words + j].store(w, std::memory_order_relaxed);
+      }
+    }
+    void move(size_type to, AtomicKeys &from, size_type at) {
+      for (size_type j{0}; j < words; ++j)
+        slots[to * words + j].store(
+            from.slots[at * words + j].load(std::memory_order_relaxed),
+            std::memory_order_relaxed);
+    }
+  };
+  using Keys = std::conditional_t<optimistic, AtomicKeys, PlainKeys>;
+
+  //////////   BUCKET   //////////
+  struct alignas(64) Bucket {
+    std::atomic<std::uint64_t> version{0};
+    size_type local_depth;
+    std::atomic<size_type> count{0};
+    Keys keys;
+    explicit Bucket(size_type depth) : local_depth(depth) {}
+    // the acquire RMW keeps the writes that follow from moving above it
+    void begin_write() { version.fetch_add(1, std::memory_order_acq_rel); }
+    void end_write() { version.fetch_add(1, std::memory_order_release); }
+    // writers and locked readers only
+    size_type locate(const key_type &key, const key_equal &equal) const {
+      size_type n = count.load(std::memory_order_relaxed);
+      for (size_type i{0}; i < n; ++i) {
+        if (equal(keys.get(i), key))
+          return i;
+      }
+      return n;
+    }
+  };
+  using Tables = EpochTables<Bucket, Allocator>;
+  using Table = typename Tables::Table;
+
+  //////////   INSTANZ VARS   //////////
+  MixedHash<hasher> hashing;
+  key_equal equal;
+  Tables tables;
+  std::atomic<Table *> current;
+  std::atomic<size_type> current_size{0};
+  // writers hold it exclusive; lookups of non trivially copyable keys and
+  // for_each hold it shared
+  mutable std::shared_mutex writer;
+
+  Table *double_catalog(Table *table);
+  void split_bucket(Table *table, Bucket *bucket, size_type hash);
+  static Bucket *bucket_for(const Table *table, size_type hash) {
+    size_type mask = (size_type{1} << table->global_depth) - 1;
+    return table->slots[hash & mask].load(std::memory_order_seq_cst);
+  }
+
+public:
+  explicit SeqlockADS_set(const allocator_type &alloc = allocator_type());
+  // for stateful (e.g. seeded) hashers; the copies are kept in the set
+  SeqlockADS_set(const hasher &hash, const key_equal &equal = key_equal(),
+                 const allocator_type &alloc = allocator_type());
+  SeqlockADS_set(std::initializer_list<key_type> ilist);
+  SeqlockADS_set(const SeqlockADS_set &) = delete;
+  SeqlockADS_set &operator=(const SeqlockADS_set &) = delete;
+  ~SeqlockADS_set();
+
+  size_type size() const {
+    return current_size.load(std::memory_order_relaxed);
+  }
+  bool empty() const { return size() == 0; }
+  bool insert(const key_type &key);
+  void insert(std::initializer_list<key_type> ilist);
+  template <typename InputIt> void insert(InputIt first, InputIt last);
+  size_type erase(const key_type &key);
+  void clear();
+  size_type count(const key_type &key) const;
+  bool contains(const key_type &key) const { return count(key) != 0; }
+  // f must not modify this set
+  template <typename F> void for_each(F f) const;
+  hasher hash_function() const { return hashing.function(); }
+  key_equal key_eq() const { return equal; }
+};
+
+//////////   HELPERS   ////////////////////   HELPERS   //////////
+
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+typename SeqlockADS_set<Key, N, Allocator, Hash, KeyEqual>::Table *
+SeqlockADS_set<Key, N, Allocator, Hash, KeyEqual>::double_catalog(
+    Table *table) {
+  size_type size = size_type{1} << table->global_depth;
+  tables.reserve(0, 1);
+  Table *doubled = tables.make_table(table->global_depth + 1);
+  for (size_type i{0}; i < size; ++i) {
+    Bucket *bucket = table->slots[i].load(std::memory_order_relaxed);
+    doubled->slots[i].store(bucket, std::memory_order_relaxed);
+    doubled->slots[i + size].store(bucket, std::memory_order_relaxed);
+  }
+  current.store(doubled, std::memory_order_seq_cst);
+  tables.retire(table);
+  return doubled;
+}
+// the sibling is filled before any slot points at it; the old bucket's
+// version stays odd until its moved-out slots point at the sibling
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void SeqlockADS_set<Key, N, Allocator, Hash, KeyEqual>::split_bucket(
+    Table *table, Bucket *bucket, size_type hash) {
+  size_type mask = size_type{1} << bucket->local_depth;
+  Bucket *sibling = tables.make_bucket(bucket->local_depth + 1);
+  bucket->begin_write();
+  size_type old_count = bucket->count.load(std::memory_order_relaxed);
+  size_type kept{0}, moved{0};
+  for (size_type i{0}; i < old_count; ++i) {
+    if ((hashing(bucket->keys.get(i)) & mask) == 0) {
+      if (kept != i)
+        bucket->keys.move(kept, bucket->keys, i);
+      ++kept;
+    } else {
+      sibling->keys.move(moved++, bucket->keys, i);
+    }
+  }
+  bucket->count.store(kept, std::memory_order_relaxed);
+  sibling->count.store(moved, std::memory_order_relaxed);
+  ++bucket->local_depth;
+  size_type size = size_type{1} << table->global_depth;
+  for (size_type i = (hash & (mask - 1)) | mask; i < size; i += mask << 1)
+    table->slots[i].store(sibling, std::memory_order_seq_cst);
+  bucket->end_write();
+}
+
+//////////   CONSTR   ////////////////////   CONSTR   //////////
+
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+SeqlockADS_set<Key, N, Allocator, Hash, KeyEqual>::SeqlockADS_set(
+    const allocator_type &alloc)
+    : SeqlockADS_set(hasher(), key_equal(), alloc) {}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+SeqlockADS_set<Key, N, Allocator, Hash, KeyEqual>::SeqlockADS_set(
+    const hasher &hash, const key_equal &equal, const allocator_type &alloc)
+    : hashing(hash), equal(equal), tables(alloc) {
+  current.store(tables.make_root(), std::memory_order_relaxed);
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+SeqlockADS_set<Key, N, Allocator, Hash, KeyEqual>::SeqlockADS_set(
+    std::initializer_list<key_type> ilist)
+    : SeqlockADS_set() {
+  insert(ilist);
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+SeqlockADS_set<Key, N, Allocator, Hash, KeyEqual>::~SeqlockADS_set() {
+  tables.drop_all(current.load(std::memory_order_relaxed));
+}
+
+//////////   INSERT & REMOVE   //////////
+
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+bool SeqlockADS_set<Key, N, Allocator, Hash, KeyEqual>::insert(
+    const key_type &key) {
+  size_type hash = hashing(key);
+  std::unique_lock<std::shared_mutex> guard(writer);
+  Table *table = current.load(std::memory_order_relaxed);
+  for (;;) {
+    Bucket *bucket = bucket_for(table, hash);
+    size_type count = bucket->count.load(std::memory_order_relaxed);
+    if (bucket->locate(key, equal) < count)
+      return false;
+    if (count < N) {
+      bucket->begin_write();
+      bucket->keys.put(count, key);
+      bucket->count.store(count + 1, std::memory_order_relaxed);
+      bucket->end_write();
+      current_size.store(size() + 1, std::memory_order_relaxed);
+      return true;
+    }
+    if (bucket->local_depth == table->global_depth)
+      table = double_catalog(table);
+    split_bucket(table, bucket, hash);
+  }
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void SeqlockADS_set<Key, N, Allocator, Hash, KeyEqual>::insert(
+    std::initializer_list<key_type> ilist) {
+  insert(ilist.begin(), ilist.end());
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+template <typename InputIt>
+void SeqlockADS_set<Key, N, Allocator, Hash, KeyEqual>::insert(
+    InputIt first, InputIt last) {
+  for (; first != last; ++first)
+    insert(*first);
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+typename SeqlockADS_set<Key, N, Allocator, Hash, KeyEqual>::size_type
+SeqlockADS_set<Key, N, Allocator, Hash, KeyEqual>::erase(
+    const key_type &key) {
+  size_type hash = hashing(key);
+  std::unique_lock<std::shared_mutex> guard(writer);
+  Bucket *bucket = bucket_for(current.load(std::memory_order_relaxed), hash);
+  size_type count = bucket->count.load(std::memory_order_relaxed);
+  size_type at = bucket->locate(key, equal);
+  if (at == count)
+    return 0;
+  bucket->begin_write();
+  if (at + 1 < count)
+    bucket->keys.move(at, bucket->keys, count - 1);
+  bucket->count.store(count - 1, std::memory_order_relaxed);
+  bucket->end_write();
+  current_size.store(size() - 1, std::memory_order_relaxed);
+  return 1;
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+void SeqlockADS_set<Key, N, Allocator, Hash, KeyEqual>::clear() {
+  std::unique_lock<std::shared_mutex> guard(writer);
+  Table *table = current.load(std::memory_order_relaxed);
+  Table *fresh = tables.make_root();
+  try {
+    tables.reserve(size_type{1} << table->global_depth, 1);
+  } catch (...) {
+    tables.drop_all(fresh);
+    throw;
+  }
+  current.store(fresh, std::memory_order_seq_cst);
+  current_size.store(0, std::memory_order_relaxed);
+  tables.retire_all(table);
+}
+
+//////////   SEARCH   ////////////////////   SEARCH   //////////
+
+// A version read after a writer's end_write() also shows the slot and
+// directory stores made before it, so a reader that came in through a
+// replaced slot or directory notices on the second look.
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+typename SeqlockADS_set<Key, N, Allocator, Hash, KeyEqual>::size_type
+SeqlockADS_set<Key, N, Allocator, Hash, KeyEqual>::count(
+    const key_type &key) const {
+  size_type hash = hashing(key);
+  if constexpr (!optimistic) {
+    std::shared_lock<std::shared_mutex> guard(writer);
+    const Bucket *bucket =
+        bucket_for(current.load(std::memory_order_relaxed), hash);
+    return bucket->locate(key, equal) <
+                   bucket->count.load(std::memory_order_relaxed)
+               ? 1
+               : 0;
+  } else {
+    EpochDomain::ReadGuard guard(tables.domain());
+    alignas(key_type) unsigned char copy[sizeof(key_type) * N];
+    for (;;) {
+      const Table *table = current.load(std::memory_order_seq_cst);
+      const Bucket *bucket = bucket_for(table, hash);
+      std::uint64_t version = bucket->version.load(std::memory_order_acquire);
+      if (version & 1)
+        continue;
+      // a count from mid-write must not send the copy past the slots
+      size_type count =
+          std::min<size_type>(bucket->count.load(std::memory_order_relaxed), N);
+      for (size_type i{0}; i < count; ++i)
+        bucket->keys.copy_out(i, copy + i * sizeof(key_type));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (bucket->version.load(std::memory_order_relaxed) != version ||
+          bucket_for(table, hash) != bucket ||
+          current.load(std::memory_order_relaxed) != table)
+        continue;
+      const key_type *keys =
+          std::launder(reinterpret_cast<const key_type *>(copy));
+      for (size_type i{0}; i < count; ++i) {
+        if (equal(keys[i], key))
+          return 1;
+      }
+      return 0;
+    }
+  }
+}
+template <typename Key, size_t N, typename Allocator, typename Hash,
+          typename KeyEqual>
+template <typename F>
+void SeqlockADS_set<Key, N, Allocator, Hash, KeyEqual>::for_each(F f) const {
+  std::shared_lock<std::shared_mutex> guard(writer);
+  Tables::each_bucket(current.load(std::memory_order_relaxed),
+                      [&f](const Bucket *bucket) {
+                        size_type count =
+                            bucket->count.load(std::memory_order_relaxed);
+                        for (size_type i{0}; i < count; ++i)
+                          f(static_cast<const key_type &>(
+                              bucket->keys.get(i)));
+                      });
+}
+
+#endif // SEQLOCK_ADS_SET_H
@@ -15,6 +15,7 @@
 #include <future>
 #include <iostream>
 #include <iterator>
+#include <memory>
 #include <random>
 #include <set>
 #include <sstream>
@@ -25,6 +26,11 @@
 #include <stdio.h>
 #include <unistd.h>
 
+// the parallel bulk load is opt-in, so test it here
+#ifndef ADS_SET_BULK_THREADS
+#define ADS_SET_BULK_THREADS 4
+#endif
+
 #include "ADS_set.h"
 
 #if !defined PH1 && !defined PH2
@@ -135,6 +141,15 @@ namespace ads {
 #else
         ADS_set<T>;
 #endif
+
+    // ads::set with another hasher and key_equal
+    template <class T, class Hash, class KeyEqual>
+    using set_with =
+#ifdef SIZE
+        ADS_set<T, SIZE, std::allocator<T>, Hash, KeyEqual>;
+#else
+        ADS_set<T, 63, std::allocator<T>, Hash, KeyEqual>;
+#endif
 }
 
 // gestohlen aus simpletest
@@ -153,7 +168,8 @@ bool it_equal(const C1 &c1, const It1 &it1, const C2 &c2, const It2 &it2) {
            (it1 != c1.end() && it2 != c2.end() && std::equal_to<typename C1::value_type>{}(*it1, *it2));
 }
 
-bool operator==(ads::set<val_t> const& lhs, std::set<val_t> const& rhs) {
+template <size_t N, typename A, typename H, typename E>
+bool operator==(ADS_set<val_t, N, A, H, E> const& lhs, std::set<val_t> const& rhs) {
     if(lhs.size() != rhs.size()) { return false; }
     for(auto const& v: rhs) { if(!lhs.count(v)) { return false; } }
     return true;
@@ -169,7 +185,8 @@ bool operator!=(std::set<val_t> const& lhs, std::set<val_t> const& rhs) {
     return !(lhs == rhs);
 }
 
-bool operator!=(ads::set<val_t> const& lhs, std::set<val_t> const& rhs) {
+template <size_t N, typename A, typename H, typename E>
+bool operator!=(ADS_set<val_t, N, A, H, E> const& lhs, std::set<val_t> const& rhs) {
     return !(lhs == rhs);
 }
 
@@ -190,7 +207,8 @@ void wait_read(float d=5) {
     std::cerr << '\r';
 }
 
-void dump_compare(ads::set<val_t> const& a, std::set<val_t> const& r, bool force_read=true) {
+template <typename Set>
+void dump_compare(Set const& a, std::set<val_t> const& r, bool force_read=true) {
     if(force_read) { wait_read(); }
     std::cerr << "values that were expected:\n\n";
 
@@ -202,7 +220,8 @@ void dump_compare(ads::set<val_t> const& a, std::set<val_t> const& r, bool force
     std::cerr << "size = " << a.size() << " (should be " << r.size() << ")\n";
 }
 
-void sanity_check(std::string const& where, ads::set<val_t> const& a, std::set<val_t> const& r) {
+template <typename Set>
+void sanity_check(std::string const& where, Set const& a, std::set<val_t> const& r) {
     if(a != r) {
         std::cerr << RED("[" << where << "] err: sanity check failed --- equality does not hold.\n")
                   << CYAN("NOTE: ") << "equality is checked using count() and size().\n\n";
@@ -578,6 +597,29 @@ void test_range_constructor3(size_t n, size_t max_value, RNG& gen) {
     sanity_check("range_constructor3", a, r);
 }
 
+// enough keys for the parallel bulk load, about half of them duplicates
+void test_bulk_insert(RNG& gen) {
+    std::cerr << "\n=== test_bulk_insert ===\n";
+    size_t const n = 300'000;
+    std::uniform_int_distribution<size_t> dist{ 0, n / 2 };
+    std::vector<val_t> vs;
+    for(size_t i = 0; i < n; ++i) { vs.push_back(dist(gen)); }
+    std::set<val_t> r{ vs.begin(), vs.end() };
+
+    ads::set<val_t> a;
+    a.insert(vs.begin(), vs.end());
+    sanity_check("bulk insert", a, r);
+
+    ads::set<val_t> b{ vs.begin(), vs.end() };
+    sanity_check("bulk range constructor", b, r);
+
+    // a set that is not empty takes the keys one by one
+    for(size_t i = 0; i < n; ++i) { vs[i] = dist(gen) + n; }
+    r.insert(vs.begin(), vs.end());
+    a.insert(vs.begin(), vs.end());
+    sanity_check("bulk insert into a non-empty set", a, r);
+}
+
 void test_empty(ads::set<val_t> const& a, std::set<val_t> const& r) {
     std::cerr << "\n=== test_empty ===\n";
 
@@ -1035,6 +1077,376 @@ void test_inequality(ads::set<val_t> const& a1, std::set<val_t> const& r1, ads::
         std::abort();
     }
 }
+
+// the global depth as printed by dump()
+template <typename Set>
+size_t global_depth(Set const& a) {
+    std::stringstream buf;
+    a.dump(buf);
+    std::string s = buf.str();
+    return std::stoul(s.substr(s.find("Global depth: ") + 14));
+}
+
+void test_erase_all(ads::set<val_t>& a, std::set<val_t>& r, RNG& gen) {
+    std::cerr << "\n=== test_erase_all ===\n";
+    std::vector<val_t> vs{ r.begin(), r.end() };
+    std::shuffle(vs.begin(), vs.end(), gen);
+    for(auto const& v: vs) {
+        std::cerr << "er " << v << '\n';
+        size_t c_a = a.erase(v);
+        size_t c_r = r.erase(v);
+
+        if(c_a != c_r) {
+            std::cerr << RED("[erase_all] err: erase returned " << c_a << " for value " << v
+                      << ", but should've returned " << c_r << '\n');
+
+            dump_compare(a, r);
+            std::abort();
+        }
+
+        sanity_check("erase_all", a, r);
+    }
+
+    // merging buddies has to halve the directory back down
+    if(global_depth(a) > 1) {
+        std::cerr << RED("[erase_all] err: global depth is " << global_depth(a)
+                  << " after erasing every value, but should've been at most 1\n");
+
+        dump_compare(a, r);
+        std::abort();
+    }
+}
+
+void test_reserve(size_t n, size_t max_value, RNG& gen) {
+    std::cerr << "\n=== test_reserve ===\n";
+    std::uniform_int_distribution<size_t> dist{ 0, max_value };
+    std::vector<val_t> vs;
+    for(size_t i = 0; i < n; ++i) { vs.push_back(dist(gen)); }
+    std::set<val_t> r{ vs.begin(), vs.end() };
+
+    ads::set<val_t> a1(n);
+    size_t depth = global_depth(a1);
+    a1.insert(vs.begin(), vs.end());
+    sanity_check("reserve: capacity constructor", a1, r);
+
+    ads::set<val_t> a2(vs.begin(), vs.end(), n);
+    sanity_check("reserve: range constructor with capacity", a2, r);
+
+    ads::set<val_t> a3;
+    a3.insert(vs.begin(), vs.begin() + n / 2);
+    a3.reserve(n * 4);
+    a3.insert(vs.begin() + n / 2, vs.end());
+    sanity_check("reserve", a3, r);
+
+    // the reserved buckets stay in place through erase
+    for(auto const& v: r) { a1.erase(v); }
+    if(!a1.empty() || global_depth(a1) < depth) {
+        std::cerr << RED("[reserve] err: global depth dropped from " << depth << " to "
+                  << global_depth(a1) << " after erasing every value\n");
+
+        dump_compare(a1, std::set<val_t>{});
+        std::abort();
+    }
+}
+
+void test_move_emplace(size_t n, size_t max_value, RNG& gen) {
+    std::cerr << "\n=== test_move_emplace ===\n";
+    std::uniform_int_distribution<size_t> dist{ 0, max_value };
+    ads::set<val_t> a;
+    std::set<val_t> r;
+    for(size_t i = 0; i < n; ++i) {
+        size_t v = dist(gen);
+
+        std::cerr << "em " << v << '\n';
+        auto it_r = r.emplace(v);
+        auto it_a = i % 2 ? a.emplace(v) : a.insert(val_t{ v });
+
+        if(it_a.second != it_r.second || !it_equal(a, it_a.first, r, it_r.first)) {
+            std::cerr << RED("[move_emplace] err: emplacing " << v << " returned ("
+                      << it2str(a, it_a.first) << ", " << std::boolalpha << it_a.second
+                      << "), but should've returned (" << it2str(r, it_r.first) << ", " << it_r.second << ")\n");
+
+            dump_compare(a, r);
+            std::abort();
+        }
+    }
+    sanity_check("emplace", a, r);
+
+    ads::set<val_t> moved{ std::move(a) };
+    sanity_check("move constructor", moved, r);
+    sanity_check("moved-from set", a, std::set<val_t>{});
+
+    a = std::move(moved);
+    sanity_check("move assignment", a, r);
+
+    // a moved-from set has to take new values
+    moved.insert(val_t{ 0 });
+    sanity_check("insert after move", moved, std::set<val_t>{ val_t{ 0 } });
+}
+
+// claims to avalanche, so ADS_set indexes by the value itself until it
+// reseeds and mixes in the seed
+struct identity_hash {
+    using is_avalanching = void;
+    size_t operator()(val_t const& v) const { return v.i; }
+};
+
+// the depth a uniform hash needs for n values at about 2/3 bucket occupancy
+size_t uniform_depth(size_t n, size_t bucket_size) {
+    size_t depth = 1;
+    while((size_t{ 1 } << depth) * std::max<size_t>(1, bucket_size * 2 / 3) < n) { ++depth; }
+    return depth;
+}
+
+// Values strided by 2^24 under identity_hash share their low 24 bits, so
+// without a reseed every split past the first deepens the directory beyond
+// 24. The set has to reseed, keep its values through erases and a snapshot,
+// and settle near the depth a uniform hash needs. N is fixed at 7, since
+// below ADS_SET_MIX_MIN_SIZE sets never reseed.
+void test_reseed(size_t n, size_t max_value, RNG& gen) {
+    std::cerr << "\n=== test_reseed ===\n";
+    using reseed_set = ADS_set<val_t, 7, std::allocator<val_t>, identity_hash>;
+    std::uniform_int_distribution<size_t> dist_i{ 0, max_value };
+    std::uniform_real_distribution<double> dist_f{ 0, 1 };
+    reseed_set a;
+    std::set<val_t> r;
+    for(size_t i = 0; i < 3 * n; ++i) {
+        val_t v = dist_i(gen) << 24;
+        if(dist_f(gen) < .75) {
+            std::cerr << "in " << v << '\n';
+            a.insert(v);
+            r.insert(v);
+        } else {
+            std::cerr << "er " << v << '\n';
+            a.erase(v);
+            r.erase(v);
+        }
+    }
+    sanity_check("reseed", a, r);
+
+    auto check_depth = [](std::string const& where, reseed_set const& s, std::set<val_t> const& ref) {
+        size_t limit = uniform_depth(ref.size(), 7) + s.reseed_slack();
+        if(global_depth(s) >= limit) {
+            std::cerr << RED("[" << where << "] err: global depth is " << global_depth(s) << " for "
+                      << ref.size() << " values, but should've been below " << limit << '\n');
+
+            dump_compare(s, ref);
+            std::abort();
+        }
+    };
+    check_depth("reseed", a, r);
+
+    // the snapshot carries the seed; growing it past twice the size of the
+    // last reseed may reseed again, while the origin keeps its buckets
+    reseed_set copy = a.snapshot();
+    std::set<val_t> written = r;
+    for(size_t i = 0; i < 3 * n; ++i) {
+        val_t v = (max_value + 1 + 2 * dist_i(gen)) << 24;
+        if(dist_f(gen) < .75) {
+            copy.insert(v);
+            written.insert(v);
+        } else {
+            val_t old = dist_i(gen) << 24;
+            copy.erase(old);
+            written.erase(old);
+        }
+    }
+    sanity_check("reseed: origin of snapshot", a, r);
+    sanity_check("reseed: snapshot", copy, written);
+    check_depth("reseed: snapshot", copy, written);
+}
+
+void test_count_many(ads::set<val_t> const& a, std::set<val_t> const& r, size_t max_value) {
+    std::cerr << "\n=== test_count_many ===\n";
+    std::vector<val_t> keys;
+    for(size_t i = 0; i <= max_value + 1; ++i) { keys.push_back(i); }
+    std::vector<std::uint64_t> bits((keys.size() + 63) / 64);
+    std::unique_ptr<bool[]> found{ new bool[keys.size()] };
+
+    size_t hits = a.count_many(keys.data(), keys.size(), bits.data());
+    a.contains_many(keys.data(), keys.size(), found.get());
+
+    size_t expected = 0;
+    for(size_t i = 0; i < keys.size(); ++i) {
+        bool in_r = r.count(keys[i]);
+        bool bit = bits[i / 64] >> (i % 64) & 1;
+        expected += in_r;
+
+        if(bit != in_r || found[i] != in_r) {
+            std::cerr << RED("[count_many] err: value " << keys[i] << " reported as " << (bit ? "" : "not ")
+                      << "counted and " << (found[i] ? "" : "not ") << "contained, but is "
+                      << (in_r ? "" : "not ") << "in the set\n");
+
+            dump_compare(a, r);
+            std::abort();
+        }
+    }
+
+    if(hits != expected) {
+        std::cerr << RED("[count_many] err: returned " << hits << " hits, but should've returned " << expected << '\n');
+
+        dump_compare(a, r);
+        std::abort();
+    }
+}
+
+// insert_hashed, erase_hashed, count_hashed and find_hashed with the hasher's
+// own value have to agree with std::set
+void test_hashed(size_t n, size_t max_value, RNG& gen) {
+    std::cerr << "\n=== test_hashed ===\n";
+    std::uniform_int_distribution<size_t> dist_i{ 0, max_value };
+    std::uniform_int_distribution<size_t> dist_op{ 0, 2 };
+    ads::set<val_t> a;
+    std::set<val_t> r;
+    auto hash = a.hash_function();
+    for(size_t i = 0; i < 3 * n; ++i) {
+        val_t v = dist_i(gen);
+        switch(dist_op(gen)) {
+        case 0: {
+            std::cerr << "in " << v << '\n';
+            auto it_a = a.insert_hashed(v, hash(v));
+            auto it_r = r.insert(v);
+
+            if(it_a.second != it_r.second || !it_equal(a, it_a.first, r, it_r.first)) {
+                std::cerr << RED("[hashed] err: insert_hashed of " << v << " returned ("
+                          << it2str(a, it_a.first) << ", " << std::boolalpha << it_a.second
+                          << "), but should've returned (" << it2str(r, it_r.first) << ", " << it_r.second << ")\n");
+
+                dump_compare(a, r);
+                std::abort();
+            }
+            break;
+        }
+        case 1: {
+            std::cerr << "er " << v << '\n';
+            size_t c_a = a.erase_hashed(v, hash(v));
+            size_t c_r = r.erase(v);
+
+            if(c_a != c_r) {
+                std::cerr << RED("[hashed] err: erase_hashed returned " << c_a << " for value " << v
+                          << ", but should've returned " << c_r << '\n');
+
+                dump_compare(a, r);
+                std::abort();
+            }
+            break;
+        }
+        default: {
+            std::cerr << "cn " << v << '\n';
+            size_t c_a = a.count_hashed(v, hash(v));
+            size_t c_r = r.count(v);
+            auto it_a = a.find_hashed(v, hash(v));
+            auto it_r = r.find(v);
+
+            if(c_a != c_r || !it_equal(a, it_a, r, it_r)) {
+                std::cerr << RED("[hashed] err: count_hashed and find_hashed of " << v << " returned " << c_a
+                          << " and " << it2str(a, it_a) << ", but should've returned " << c_r
+                          << " and " << it2str(r, it_r) << '\n');
+
+                dump_compare(a, r);
+                std::abort();
+            }
+        }
+        }
+    }
+    sanity_check("hashed", a, r);
+}
+
+#ifdef __cpp_impl_coroutine
+void test_contains_interleaved(ads::set<val_t> const& a, std::set<val_t> const& r, size_t max_value) {
+    std::cerr << "\n=== test_contains_interleaved ===\n";
+    std::vector<val_t> keys;
+    for(size_t i = 0; i <= max_value + 1; ++i) { keys.push_back(i); }
+    std::unique_ptr<bool[]> found{ new bool[keys.size()] };
+
+    for(size_t lanes: { 1, 3, 16 }) {
+        a.contains_interleaved(keys.data(), keys.size(), found.get(), lanes);
+
+        for(size_t i = 0; i < keys.size(); ++i) {
+            bool in_r = r.count(keys[i]);
+
+            if(found[i] != in_r) {
+                std::cerr << RED("[contains_interleaved] err: with " << lanes << " lanes value " << keys[i]
+                          << " reported as " << (found[i] ? "" : "not ") << "contained, but is "
+                          << (in_r ? "" : "not ") << "in the set\n");
+
+                dump_compare(a, r);
+                std::abort();
+            }
+        }
+    }
+}
+#endif
+
+// transparent over val_t and a plain size_t; counts the hashes of plain
+// size_ts, so a lookup that built a val_t first shows up
+struct val_hash {
+    using is_transparent = void;
+    static size_t plain_calls;
+    size_t operator()(val_t const& v) const { return std::hash<val_t>{}(v); }
+    size_t operator()(size_t i) const { ++plain_calls; return std::hash<size_t>{}(i); }
+};
+size_t val_hash::plain_calls = 0;
+
+struct val_equal {
+    using is_transparent = void;
+    bool operator()(val_t const& lhs, val_t const& rhs) const { return std::equal_to<val_t>{}(lhs, rhs); }
+    bool operator()(val_t const& lhs, size_t rhs) const { return std::equal_to<val_t>{}(lhs, val_t{ rhs }); }
+    bool operator()(size_t lhs, val_t const& rhs) const { return std::equal_to<val_t>{}(val_t{ lhs }, rhs); }
+};
+
+void test_transparent(size_t n, size_t max_value, RNG& gen) {
+    std::cerr << "\n=== test_transparent ===\n";
+    std::uniform_int_distribution<size_t> dist{ 0, max_value };
+    ads::set_with<val_t, val_hash, val_equal> a;
+    std::set<val_t> r;
+    for(size_t i = 0; i < n; ++i) {
+        size_t v = dist(gen);
+        a.insert(val_t{ v });
+        r.insert(v);
+    }
+    sanity_check("transparent: insert", a, r);
+
+    size_t before = val_hash::plain_calls;
+    for(size_t i = 0; i <= max_value + 1; ++i) {
+        bool in_r = r.count(i);
+        bool counted = a.count(i);
+        bool contained = a.contains(i);
+        auto it = a.find(i);
+        bool found = it != a.end() && it->i == i;
+
+        if(counted != in_r || contained != in_r || found != in_r) {
+            std::cerr << RED("[transparent] err: size_t " << i << " reported as " << (counted ? "" : "not ")
+                      << "counted, " << (contained ? "" : "not ") << "contained and " << (found ? "" : "not ")
+                      << "found, but is " << (in_r ? "" : "not ") << "in the set\n");
+
+            dump_compare(a, r);
+            std::abort();
+        }
+    }
+    if(val_hash::plain_calls - before != 3 * (max_value + 2)) {
+        std::cerr << RED("[transparent] err: " << val_hash::plain_calls - before << " size_t keys hashed for "
+                  << 3 * (max_value + 2) << " lookups, the others went through val_t\n");
+        std::abort();
+    }
+
+    std::vector<val_t> vs{ r.begin(), r.end() };
+    std::shuffle(vs.begin(), vs.end(), gen);
+    for(size_t i = 0; i < vs.size() / 2; ++i) {
+        size_t v = vs[i].i;
+        size_t c_a = a.erase(v);
+        size_t c_r = r.erase(v);
+
+        if(c_a != c_r) {
+            std::cerr << RED("[transparent] err: erase returned " << c_a << " for size_t " << v
+                      << ", but should've returned " << c_r << '\n');
+
+            dump_compare(a, r);
+            std::abort();
+        }
+    }
+    sanity_check("transparent: erase", a, r);
+}
 #endif
 
 void test_all_ph1(size_t n, size_t max_value, RNG& gen) {
@@ -1276,6 +1688,25 @@ void test_all_ph2(size_t n, size_t max_value, RNG& gen) {
         test_equality(a1, r1, a3, r3);
         test_inequality(a1, r1, a3, r3);
     }
+
+    {
+        std::cerr << "\n----\n";
+        ads::set<val_t> a;
+        std::set<val_t> r;
+
+        test_insert_it(a, r, n, max_value, gen);
+        test_count_many(a, r, max_value);
+#ifdef __cpp_impl_coroutine
+        test_contains_interleaved(a, r, max_value);
+#endif
+        test_erase_all(a, r, gen);
+    }
+
+    test_reserve(n, max_value, gen);
+    test_move_emplace(n, max_value, gen);
+    test_reseed(n, max_value, gen);
+    test_transparent(n, max_value, gen);
+    test_hashed(n, max_value, gen);
 }
 #endif
 
@@ -1599,6 +2030,8 @@ int main(int argc, char** argv) {
     test_initlist_constructor2();
     test_range_constructor2();
 
+    test_bulk_insert(gen);
+
     for(size_t i = 0; i < t; ++i) {
         for(size_t n_ = n; n_ <= o; n_ += m) {
             for(size_t v_ = v; v_ <= x; v_ += w) {
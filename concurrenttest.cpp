@@ -0,0 +1,265 @@
+// Tests for the thread-safe sets and for ADS_set snapshots.
+//
+// Every concurrent set gets the same workload: each thread inserts, erases
+// and counts keys of its own stripe and checks every answer against its own
+// std::set, while also counting the other threads' keys, whose answers
+// cannot be checked. Afterwards the set has to equal the union of the
+// references. The keys are strided by 2^24, which std::hash leaves with
+// all-zero low bits, so a set that indexes by the raw hash piles them into
+// one bucket.
+//
+// g++ -Wall -Wextra -Werror -O2 -std=c++17 -pthread concurrenttest.cpp -o concurrenttest
+// g++ -Wall -Wextra -O1 -g -std=c++17 -fsanitize=thread concurrenttest.cpp -o concurrenttest
+// g++ -Wall -Wextra -O1 -g -std=c++17 -fsanitize=address,undefined -pthread concurrenttest.cpp -o concurrenttest
+//
+// ./concurrenttest [threads] [operations per thread]
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "ADS_hashers.h"
+#include "ADS_set.h"
+#include "ActorADS_set.h"
+#include "ConcurrentADS_set.h"
+#include "DedupADS_set.h"
+#include "EpochADS_set.h"
+#include "LockingADS_set.h"
+#include "SeqlockADS_set.h"
+
+#define CHECK(cond)                                                          \
+    do {                                                                     \
+        if (!(cond)) {                                                       \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " << current      \
+                      << ": check failed: " #cond "\n";                      \
+            std::exit(1);                                                    \
+        }                                                                    \
+    } while (0)
+
+static const char *current = "";
+static size_t threads = 8;
+static size_t operations = 20000;
+static constexpr size_t key_space = 4096; // per thread
+
+static size_t key_of(size_t thread, size_t i) {
+    return (i * threads + thread) << 24;
+}
+
+// Calls op(thread, reference, rng) on every thread and returns the union of
+// the references.
+template <typename Op>
+std::set<size_t> run_threads(Op op) {
+    std::vector<std::set<size_t>> refs(threads);
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t)
+        workers.emplace_back([&, t] {
+            std::mt19937_64 rng(t + 1);
+            op(t, refs[t], rng);
+        });
+    for (std::thread &worker : workers)
+        worker.join();
+    std::set<size_t> all;
+    for (const std::set<size_t> &ref : refs)
+        all.insert(ref.begin(), ref.end());
+    return all;
+}
+
+// one random insert, erase or count on the stripe of thread t, checked
+// against ref, plus an unchecked count of some other thread's key
+template <typename Set>
+void random_step(Set &set, size_t t, std::set<size_t> &ref,
+                 std::mt19937_64 &rng) {
+    size_t key = key_of(t, rng() % key_space);
+    switch (rng() % 4) {
+    case 0:
+    case 1:
+        CHECK(set.insert(key) == ref.insert(key).second);
+        break;
+    case 2:
+        CHECK(set.erase(key) == ref.erase(key));
+        break;
+    default:
+        CHECK(set.count(key) == ref.count(key));
+    }
+    set.count(key_of(rng() % threads, rng() % key_space));
+}
+
+template <typename Set>
+void check_final(Set &set, const std::set<size_t> &all) {
+    CHECK(set.size() == all.size());
+    for (size_t t = 0; t < threads; ++t)
+        for (size_t i = 0; i < key_space; ++i) {
+            size_t key = key_of(t, i);
+            CHECK(set.count(key) == all.count(key));
+        }
+}
+
+template <typename Set>
+void test_mixed(const char *name, Set &set) {
+    current = name;
+    std::set<size_t> all = run_threads(
+        [&set](size_t t, std::set<size_t> &ref, std::mt19937_64 &rng) {
+            for (size_t i = 0; i < operations; ++i)
+                random_step(set, t, ref, rng);
+        });
+    check_final(set, all);
+    std::cout << name << ": " << all.size() << " keys OK\n";
+}
+
+// Insert only. Every thread inserts the same keys, so exactly one insert
+// of each key may report it as new.
+void test_dedup() {
+    current = "DedupADS_set";
+    DedupADS_set<size_t, 15> set;
+    std::atomic<size_t> fresh{0};
+    run_threads([&](size_t t, std::set<size_t> &, std::mt19937_64 &) {
+        size_t mine = 0;
+        for (size_t i = 0; i < key_space; ++i) {
+            size_t key = key_of(0, (i * 7 + t) % key_space);
+            mine += set.insert(key);
+            CHECK(set.count(key) == 1);
+        }
+        fresh += mine;
+    });
+    CHECK(fresh == key_space);
+    CHECK(set.size() == key_space);
+    for (size_t i = 0; i < key_space; ++i)
+        CHECK(set.count(key_of(0, i)) == 1);
+    CHECK(set.count(key_of(1, 0)) == 0);
+    std::cout << current << ": " << key_space << " keys OK\n";
+}
+
+// one client per thread; the set itself cannot be shared
+void test_actor() {
+    current = "ActorADS_set";
+    ActorADS_set<size_t, 15> set(4, threads + 1, 64);
+    std::set<size_t> all =
+        run_threads([&set](size_t t, std::set<size_t> &ref,
+                           std::mt19937_64 &rng) {
+            auto client = set.connect();
+            for (size_t i = 0; i < operations; ++i)
+                random_step(client, t, ref, rng);
+            // a batch, checked key by key
+            std::vector<size_t> keys;
+            for (size_t i = 0; i < 256; ++i)
+                keys.push_back(key_of(t, rng() % key_space));
+            std::unique_ptr<bool[]> found(new bool[keys.size()]);
+            client.contains_many(keys.data(), keys.size(), found.get());
+            for (size_t i = 0; i < keys.size(); ++i)
+                CHECK(found[i] == (ref.count(keys[i]) != 0));
+        });
+    auto client = set.connect();
+    check_final(client, all);
+    std::cout << current << ": " << all.size() << " keys OK\n";
+}
+
+template <typename Set>
+bool same_keys(const Set &set, const std::set<size_t> &ref) {
+    if (set.size() != ref.size())
+        return false;
+    for (size_t key : set)
+        if (!ref.count(key))
+            return false;
+    return true;
+}
+
+// A snapshot and its origin share everything until one of them writes.
+// Whichever side changes, the other has to keep its keys, also while it is
+// read on another thread.
+void test_snapshot() {
+    current = "ADS_set::snapshot";
+    std::set<size_t> ref;
+    ADS_set<size_t, 7> origin;
+    for (size_t i = 0; i < 20000; ++i) {
+        origin.insert(key_of(0, i));
+        ref.insert(key_of(0, i));
+    }
+    for (int changed = 0; changed < 2; ++changed) {
+        ADS_set<size_t, 7> copy = origin.snapshot();
+        // the origin changes first, then the snapshot
+        ADS_set<size_t, 7> &writer = changed == 0 ? origin : copy;
+        const ADS_set<size_t, 7> &reader = changed == 0 ? copy : origin;
+        std::set<size_t> written = ref;
+        std::thread reading([&] {
+            for (int round = 0; round < 4; ++round)
+                for (size_t key : ref)
+                    CHECK(reader.count(key) == 1);
+        });
+        for (size_t i = 0; i < 20000; i += 2) {
+            writer.erase(key_of(0, i));
+            written.erase(key_of(0, i));
+            writer.insert(key_of(0, i + 20000));
+            written.insert(key_of(0, i + 20000));
+        }
+        reading.join();
+        CHECK(same_keys(reader, ref));
+        CHECK(same_keys(writer, written));
+        if (changed == 0)
+            ref = written; // the origin moved on
+    }
+    std::cout << current << ": both directions OK\n";
+}
+
+// The sharded and the actor set with a seeded hasher: every shard and
+// partition has to use the same copy, or keys go missing between them.
+void test_seeded() {
+    current = "seeded hasher";
+    ConcurrentADS_set<size_t, 7, std::allocator<size_t>, FmixHash> sharded(
+        16, FmixHash(0x9E3779B97F4A7C15ull));
+    ActorADS_set<size_t, 7, std::allocator<size_t>, FmixHash> actor(
+        4, 2, 64, FmixHash(0x9E3779B97F4A7C15ull));
+    auto client = actor.connect();
+    std::set<size_t> ref;
+    std::mt19937_64 rng(11);
+    for (size_t i = 0; i < 50000; ++i) {
+        size_t key = key_of(0, rng() % key_space);
+        if (rng() % 3) {
+            bool fresh = ref.insert(key).second;
+            CHECK(sharded.insert(key) == fresh);
+            CHECK(client.insert(key) == fresh);
+        } else {
+            size_t gone = ref.erase(key);
+            CHECK(sharded.erase(key) == gone);
+            CHECK(client.erase(key) == gone);
+        }
+    }
+    CHECK(sharded.hash_function().seed == 0x9E3779B97F4A7C15ull);
+    CHECK(actor.hash_function().seed == 0x9E3779B97F4A7C15ull);
+    check_final(sharded, ref);
+    check_final(client, ref);
+    std::cout << current << ": " << ref.size() << " keys OK\n";
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1)
+        threads = std::max<size_t>(1, std::strtoul(argv[1], nullptr, 10));
+    if (argc > 2)
+        operations = std::strtoul(argv[2], nullptr, 10);
+
+    {
+        ConcurrentADS_set<size_t, 7> set(16);
+        test_mixed("ConcurrentADS_set", set);
+    }
+    {
+        LockingADS_set<size_t, 7> set;
+        test_mixed("LockingADS_set", set);
+    }
+    {
+        EpochADS_set<size_t, 7> set;
+        test_mixed("EpochADS_set", set);
+    }
+    {
+        SeqlockADS_set<size_t, 7> set;
+        test_mixed("SeqlockADS_set", set);
+    }
+    test_dedup();
+    test_actor();
+    test_snapshot();
+    test_seeded();
+    std::cout << "all OK\n";
+}
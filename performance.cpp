@@ -1,6 +1,67 @@
 #include <iostream>
 #include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 #include "ADS_set.h"
+#include "ADS_hashers.h"
+#include "ActorADS_set.h"
+#include "ConcurrentADS_set.h"
+#include "DedupADS_set.h"
+#include "EpochADS_set.h"
+#include "LockingADS_set.h"
+#include "SeqlockADS_set.h"
+
+// Usage:
+//   ./performance                  bucket size sweep (insert/find/erase 1M ints)
+//   ./performance split [d ...]    cost of one split against a 2^(d+1) slot
+//                                  directory, default d = 10, 14, 18, 22
+//   ./performance threads [n ...]  n inserts then n lookups spread over 1..64
+//                                  threads: one mutex around an ADS_set,
+//                                  ConcurrentADS_set, LockingADS_set,
+//                                  EpochADS_set, SeqlockADS_set and the
+//                                  insert-only DedupADS_set, default n = 4M
+//   ./performance actor [n ...]    the threads workload on ActorADS_set
+//                                  (one worker per hardware thread) with
+//                                  batches of 1, 16 and 256 keys per round
+//                                  trip, against one mutex around an
+//                                  ADS_set, default n = 1M
+//   ./performance reserve [n ...]  bulk load with and without presizing,
+//                                  default n = 1M
+//   ./performance copy [n ...]     copy construction of an n-key set,
+//                                  default n = 1M and 10M
+//   ./performance hashers [n ...]  insert and lookup with std::hash and the
+//                                  hashers of ADS_hashers.h on sequential,
+//                                  strided and random ints and on strings,
+//                                  default n = 1M and 10M
+//   ./performance snapshot [n ...] snapshot() against a copy of an n-key set,
+//                                  then n / 10 inserts into the live set while
+//                                  another thread scans the snapshot, default
+//                                  n = 1M and 10M
+//   ./performance lookup [n ...]   hit/miss lookup latency for int and string
+//                                  keys, default n = 1M and 100M
+//   ./performance transparent [n ...]
+//                                  count() on 40-byte string keys sliced out
+//                                  of one buffer: through a temporary
+//                                  std::string against a transparent
+//                                  string_view lookup, default n = 1M
+//   ./performance batch [n ...]    count() loop against count_many on n int
+//                                  keys, half of them misses, default n = 100M
+//   ./performance coro [n ...]     count() loop against contains_interleaved
+//                                  with 4..32 lanes (C++20 builds only),
+//                                  default n = 100M
+//   ./performance bulk [n ...]     range constructor (parallel bulk load)
+//                                  against an insert loop on int keys,
+//                                  default n = 10M and 100M; build with
+//                                  -DADS_SET_BULK_THREADS=0 for one thread
+//                                  per hardware thread or =t for t threads,
+//                                  the default 1 loads on one thread
 
 template <typename Key, size_t N>
 void benchmark() {
@@ -24,7 +85,550 @@ void benchmark() {
     std::cout << "Bucket Size " << N << ": " << duration << " ms\n";
 }
 
-int main() {
+template <typename F>
+double time_ms(F &&f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// the sizes given after the mode, or the defaults if there are none
+std::vector<size_t> parse_sizes(int argc, char **argv,
+                                const std::vector<size_t> &defaults) {
+    std::vector<size_t> sizes;
+    for (int i = 2; i < argc; ++i)
+        sizes.push_back(std::strtoull(argv[i], nullptr, 10));
+    return sizes.empty() ? defaults : sizes;
+}
+
+template <typename Key>
+Key make_key(size_t i);
+template <>
+size_t make_key<size_t>(size_t i) { return i; }
+// long enough to live on the heap, shared prefix so equality is not free
+template <>
+std::string make_key<std::string>(size_t i) {
+    std::string digits = std::to_string(i);
+    return "session:" + std::string(24 - digits.size(), '0') + digits;
+}
+template <typename Key>
+const char *key_name();
+template <>
+const char *key_name<size_t>() { return "int"; }
+template <>
+const char *key_name<std::string>() { return "string"; }
+
+// Lookups in random order so every probe pays the directory and bucket misses.
+template <typename Key, size_t N>
+void lookup_benchmark(size_t n) {
+    std::vector<Key> keys, misses;
+    std::vector<size_t> order(n);
+    std::iota(order.begin(), order.end(), size_t{0});
+    std::shuffle(order.begin(), order.end(), std::mt19937_64{42});
+    for (size_t i : order) {
+        keys.push_back(make_key<Key>(i));
+        misses.push_back(make_key<Key>(i + n));
+    }
+    ADS_set<Key, N> set;
+    double build = time_ms([&] { set.insert(keys.begin(), keys.end()); });
+
+    size_t found = 0;
+    double hit = time_ms([&] {
+        for (const Key &k : keys)
+            found += set.count(k);
+    });
+    double miss = time_ms([&] {
+        for (const Key &k : misses)
+            found += set.count(k);
+    });
+    std::cout << "lookup " << key_name<Key>() << " n=" << n << " N=" << N
+              << ": insert " << build * 1e6 / n << " ns/op, hit "
+              << hit * 1e6 / n << " ns/op, miss " << miss * 1e6 / n
+              << " ns/op (found " << found << ")\n";
+}
+
+// Same random probe order as lookup_benchmark, but half the probes miss and
+// count_many gets the whole batch so its prefetches can overlap.
+template <size_t N>
+void batch_benchmark(size_t n) {
+    ADS_set<size_t, N> set(n);
+    for (size_t i = 0; i < n; ++i)
+        set.insert(i);
+    std::vector<size_t> probes(n);
+    std::iota(probes.begin(), probes.end(), n / 2);
+    std::shuffle(probes.begin(), probes.end(), std::mt19937_64{42});
+
+    size_t loop_hits = 0, batch_hits = 0;
+    double loop = time_ms([&] {
+        for (size_t k : probes)
+            loop_hits += set.count(k);
+    });
+    std::vector<std::uint64_t> found((n + 63) / 64);
+    double batch = time_ms([&] {
+        batch_hits = set.count_many(probes.data(), n, found.data());
+    });
+    std::cout << "batch n=" << n << " N=" << N << ": count loop "
+              << loop * 1e6 / n << " ns/op, count_many " << batch * 1e6 / n
+              << " ns/op (hits " << loop_hits << "/" << batch_hits << ")\n";
+}
+
+#ifdef __cpp_impl_coroutine
+template <size_t N>
+void coro_benchmark(size_t n) {
+    ADS_set<size_t, N> set(n);
+    for (size_t i = 0; i < n; ++i)
+        set.insert(i);
+    std::vector<size_t> probes(n);
+    std::iota(probes.begin(), probes.end(), n / 2);
+    std::shuffle(probes.begin(), probes.end(), std::mt19937_64{42});
+
+    size_t hits = 0;
+    double loop = time_ms([&] {
+        for (size_t k : probes)
+            hits += set.count(k);
+    });
+    std::cout << "coro n=" << n << " N=" << N << ": count loop "
+              << loop * 1e6 / n << " ns/op (hits " << hits << ")";
+    std::unique_ptr<bool[]> found(new bool[n]);
+    for (size_t lanes : {4, 8, 16, 32}) {
+        double t = time_ms([&] {
+            set.contains_interleaved(probes.data(), n, found.get(), lanes);
+        });
+        std::cout << ", " << lanes << " lanes " << t * 1e6 / n << " ns/op";
+    }
+    std::cout << "\n";
+}
+#endif
+
+// claims to avalanche, so ADS_set indexes by the key itself; bit reversed
+// under ADS_SET_MSB_INDEX, so the low key bits still pick the slot
+struct IdentityHash {
+    using is_avalanching = void;
+    size_t operator()(size_t key) const {
+#if ADS_SET_MSB_INDEX
+        std::uint64_t x = key;
+        x = (x >> 1 & 0x5555555555555555ull) | (x & 0x5555555555555555ull) << 1;
+        x = (x >> 2 & 0x3333333333333333ull) | (x & 0x3333333333333333ull) << 2;
+        x = (x >> 4 & 0x0f0f0f0f0f0f0f0full) | (x & 0x0f0f0f0f0f0f0f0full) << 4;
+        x = (x >> 8 & 0x00ff00ff00ff00ffull) | (x & 0x00ff00ff00ff00ffull) << 8;
+        x = (x >> 16 & 0x0000ffff0000ffffull) |
+            (x & 0x0000ffff0000ffffull) << 16;
+        return static_cast<size_t>(x >> 32 | x << 32);
+#else
+        return key;
+#endif
+    }
+};
+
+// Keys sharing their low d bits deepen the directory to d + 1, leaving the
+// bucket for slot 2^(d-1) at local depth d. Filling that bucket and timing
+// the insert that overflows it measures a single split in isolation. The
+// skew is the point here, so the set must not reseed.
+template <size_t N>
+void split_benchmark(size_t d) {
+    double best = 0;
+    for (int round = 0; round < 5; ++round) {
+        ADS_set<size_t, N, std::allocator<size_t>, IdentityHash> set;
+        set.reseed_slack(0);
+        for (size_t j = 0; j <= N; ++j)
+            set.insert(j << d);
+        size_t low = size_t{1} << (d - 1);
+        for (size_t j = 0; j < N; ++j)
+            set.insert(low + (j << d));
+        double t = time_ms([&] { set.insert(low + (N << d)); });
+        if (round == 0 || t < best)
+            best = t;
+    }
+    std::cout << "split directory=2^" << d + 1 << ": " << best * 1e3
+              << " us\n";
+}
+
+template <size_t N>
+void bulk_benchmark(size_t n) {
+    std::vector<size_t> keys(n);
+    std::iota(keys.begin(), keys.end(), size_t{0});
+    std::shuffle(keys.begin(), keys.end(), std::mt19937_64{42});
+
+    ADS_set<size_t, N> looped;
+    double loop = time_ms([&] {
+        for (size_t k : keys)
+            looped.insert(k);
+    });
+    ADS_set<size_t, N> *bulk = nullptr;
+    double range = time_ms([&] {
+        bulk = new ADS_set<size_t, N>(keys.begin(), keys.end());
+    });
+    std::cout << "bulk n=" << n << " N=" << N << " hardware threads "
+              << std::thread::hardware_concurrency() << ": insert loop "
+              << loop << " ms, range constructor " << range << " ms (equal "
+              << (*bulk == looped) << ")\n";
+    delete bulk;
+}
+
+// the baseline every concurrent variant has to beat
+template <size_t N>
+class MutexSet {
+    mutable std::mutex lock;
+    ADS_set<size_t, N> set;
+
+public:
+    bool insert(size_t key) {
+        std::lock_guard<std::mutex> guard(lock);
+        return set.insert(key).second;
+    }
+    size_t count(size_t key) const {
+        std::lock_guard<std::mutex> guard(lock);
+        return set.count(key);
+    }
+};
+
+// Every thread inserts its slice of the keys, then probes a slice of them
+// shifted by half, so half the probes hit. Wall time per phase, in Mops/s.
+template <typename Set>
+void threads_run(const char *name, const std::vector<size_t> &keys,
+                 size_t threads) {
+    Set set;
+    size_t n = keys.size();
+    auto slice = [n, threads](size_t t) { return n / threads * t; };
+    auto slice_end = [n, threads, &slice](size_t t) {
+        return t + 1 == threads ? n : slice(t + 1);
+    };
+    auto run = [&](auto &&work) {
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < threads; ++t)
+            workers.emplace_back(work, t);
+        for (std::thread &worker : workers)
+            worker.join();
+    };
+    double insert = time_ms([&] {
+        run([&](size_t t) {
+            for (size_t i = slice(t); i < slice_end(t); ++i)
+                set.insert(keys[i]);
+        });
+    });
+    std::vector<size_t> hits(threads);
+    double lookup = time_ms([&] {
+        run([&](size_t t) {
+            size_t found = 0;
+            for (size_t i = slice(t); i < slice_end(t); ++i)
+                found += set.count(keys[i] + n / 2);
+            hits[t] = found;
+        });
+    });
+    std::cout << "  " << name << ": insert " << n / insert / 1e3
+              << " Mops/s, lookup " << n / lookup / 1e3 << " Mops/s (hits "
+              << std::accumulate(hits.begin(), hits.end(), size_t{0})
+              << ")\n";
+}
+
+template <size_t N>
+void threads_benchmark(size_t n) {
+    std::vector<size_t> keys(n);
+    std::iota(keys.begin(), keys.end(), size_t{0});
+    std::shuffle(keys.begin(), keys.end(), std::mt19937_64{42});
+    for (size_t threads = 1; threads <= 64; threads <<= 1) {
+        std::cout << "threads=" << threads << " n=" << n << " N=" << N
+                  << "\n";
+        threads_run<MutexSet<N>>("mutex", keys, threads);
+        threads_run<ConcurrentADS_set<size_t, N>>("sharded", keys, threads);
+        threads_run<LockingADS_set<size_t, N>>("ellis", keys, threads);
+        threads_run<EpochADS_set<size_t, N>>("epoch", keys, threads);
+        threads_run<SeqlockADS_set<size_t, N>>("seqlock", keys, threads);
+        threads_run<DedupADS_set<size_t, N>>("dedup", keys, threads);
+    }
+}
+
+// threads_run's workload through ActorADS_set clients, `batch` keys per
+// round trip; latency is the mean wall time of one lookup round trip.
+template <size_t N>
+void actor_run(const std::vector<size_t> &keys, size_t clients,
+               size_t batch) {
+    ActorADS_set<size_t, N> set;
+    size_t n = keys.size();
+    std::vector<size_t> probes(n);
+    for (size_t i = 0; i < n; ++i)
+        probes[i] = keys[i] + n / 2;
+    auto slice = [n, clients](size_t t) { return n / clients * t; };
+    auto slice_end = [n, clients, &slice](size_t t) {
+        return t + 1 == clients ? n : slice(t + 1);
+    };
+    auto run = [&](const std::vector<size_t> &input, bool insert,
+                   std::vector<size_t> &hits) {
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < clients; ++t)
+            workers.emplace_back([&, t] {
+                auto client = set.connect();
+                size_t found = 0;
+                for (size_t i = slice(t); i < slice_end(t); i += batch) {
+                    size_t m = std::min(batch, slice_end(t) - i);
+                    found += insert
+                                 ? client.insert_many(&input[i], m, nullptr)
+                                 : client.contains_many(&input[i], m,
+                                                        nullptr);
+                }
+                hits[t] = found;
+            });
+        for (std::thread &worker : workers)
+            worker.join();
+    };
+    std::vector<size_t> inserted(clients), hits(clients);
+    double insert = time_ms([&] { run(keys, true, inserted); });
+    double lookup = time_ms([&] { run(probes, false, hits); });
+    double trips = static_cast<double>(n / clients + batch - 1) / batch;
+    std::cout << "  actor batch=" << batch << ": insert " << n / insert / 1e3
+              << " Mops/s, lookup " << n / lookup / 1e3 << " Mops/s (hits "
+              << std::accumulate(hits.begin(), hits.end(), size_t{0})
+              << "), " << lookup * 1e3 / trips << " us per round trip\n";
+}
+
+template <size_t N>
+void actor_benchmark(size_t n) {
+    std::vector<size_t> keys(n);
+    std::iota(keys.begin(), keys.end(), size_t{0});
+    std::shuffle(keys.begin(), keys.end(), std::mt19937_64{42});
+    for (size_t clients = 1; clients <= 64; clients <<= 1) {
+        std::cout << "clients=" << clients << " n=" << n << " N=" << N
+                  << " workers=" << ActorADS_set<size_t, N>::default_partitions()
+                  << "\n";
+        threads_run<MutexSet<N>>("mutex", keys, clients);
+        for (size_t batch : {1, 16, 256})
+            actor_run<N>(keys, clients, batch);
+    }
+}
+
+template <typename Key, size_t N>
+void reserve_benchmark(size_t n) {
+    std::vector<Key> keys;
+    std::vector<size_t> order(n);
+    std::iota(order.begin(), order.end(), size_t{0});
+    std::shuffle(order.begin(), order.end(), std::mt19937_64{42});
+    for (size_t i : order)
+        keys.push_back(make_key<Key>(i));
+
+    // sets are torn down outside the timed region
+    ADS_set<Key, N> growing, reserved(keys.size());
+    double grow = time_ms([&] { growing.insert(keys.begin(), keys.end()); });
+    double presized = time_ms([&] { reserved.insert(keys.begin(), keys.end()); });
+    ADS_set<Key, N> *ranged = nullptr;
+    double range = time_ms([&] {
+        ranged = new ADS_set<Key, N>(keys.begin(), keys.end(), keys.size());
+    });
+    delete ranged;
+    std::cout << "load " << key_name<Key>() << " n=" << n << " N=" << N
+              << ": growing " << grow << " ms, reserved " << presized
+              << " ms, range constructor with capacity " << range << " ms\n";
+}
+
+template <typename Key, size_t N>
+void copy_benchmark(size_t n) {
+    std::vector<Key> keys;
+    for (size_t i = 0; i < n; ++i)
+        keys.push_back(make_key<Key>(i * 2654435761u));
+    ADS_set<Key, N> set(keys.begin(), keys.end());
+    ADS_set<Key, N> *copy = nullptr;
+    double t = time_ms([&] { copy = new ADS_set<Key, N>(set); });
+    std::cout << "copy " << key_name<Key>() << " n=" << n << " N=" << N
+              << ": " << t << " ms (" << t * 1e6 / n << " ns/key, equal "
+              << (*copy == set) << ")\n";
+    delete copy;
+}
+
+template <typename Key, typename Hash>
+void hasher_run(const char *hash_name, const char *key_kind,
+                const std::vector<Key> &keys) {
+    using Set = ADS_set<Key, 63, std::allocator<Key>, Hash>;
+    std::vector<Key> probes(keys);
+    std::shuffle(probes.begin(), probes.end(), std::mt19937_64{42});
+    Set set(0, Hash());
+    double build = time_ms([&] {
+        for (const Key &k : keys)
+            set.insert(k);
+    });
+    size_t found = 0;
+    double hit = time_ms([&] {
+        for (const Key &k : probes)
+            found += set.count(k);
+    });
+    size_t n = keys.size();
+    std::cout << "hash " << hash_name << " " << key_kind << " n=" << n
+              << ": insert " << build * 1e6 / n << " ns/op, hit "
+              << hit * 1e6 / n << " ns/op (found " << found << ")\n";
+}
+
+template <typename Key>
+void hashers_benchmark(const char *key_kind, const std::vector<Key> &keys) {
+    hasher_run<Key, std::hash<Key>>("std::hash", key_kind, keys);
+    hasher_run<Key, FmixHash>("fmix", key_kind, keys);
+    hasher_run<Key, WyHash>("wy", key_kind, keys);
+    hasher_run<Key, Crc32Hash>("crc32", key_kind, keys);
+}
+
+// The first writes after a snapshot copy the directory and every bucket they
+// touch, so the inserts are timed with and without a snapshot alive.
+template <typename Key, size_t N>
+void snapshot_benchmark(size_t n) {
+    std::vector<Key> keys;
+    for (size_t i = 0; i < n + n / 10; ++i)
+        keys.push_back(make_key<Key>(i * 2654435761u));
+    ADS_set<Key, N> set(keys.begin(), keys.begin() + n);
+    ADS_set<Key, N> plain(set);
+    ADS_set<Key, N> *copy = nullptr;
+    double copied = time_ms([&] { copy = new ADS_set<Key, N>(set); });
+    delete copy;
+    ADS_set<Key, N> snap;
+    double shared = time_ms([&] { snap = set.snapshot(); });
+    double alone = time_ms([&] {
+        for (size_t i = n; i < keys.size(); ++i)
+            plain.insert(keys[i]);
+    });
+    size_t seen = 0;
+    double scan = 0;
+    std::thread reader([&] {
+        scan = time_ms([&] {
+            for (const Key &key : snap)
+                seen += key == keys[0];
+        });
+    });
+    double beside = time_ms([&] {
+        for (size_t i = n; i < keys.size(); ++i)
+            set.insert(keys[i]);
+    });
+    reader.join();
+    std::cout << "snapshot " << key_name<Key>() << " n=" << n << " N=" << N
+              << ": copy " << copied << " ms, snapshot " << shared
+              << " ms; " << n / 10 << " inserts " << alone
+              << " ms alone, " << beside << " ms with the snapshot scanned in "
+              << scan << " ms (" << snap.size() << " keys, found " << seen
+              << ")\n";
+}
+
+// A parser holds its keys as slices of one buffer. Without transparent
+// lookup, each count() first copies the slice into a std::string, which
+// allocates past the small-string buffer.
+template <size_t N>
+void transparent_benchmark(size_t n) {
+    std::string buffer;
+    std::vector<std::string_view> slices;
+    std::vector<size_t> offsets;
+    for (size_t i = 0; i < n; ++i) {
+        offsets.push_back(buffer.size());
+        std::string key = std::to_string(i);
+        buffer += std::string(40 - key.size(), 'k') + key;
+    }
+    for (size_t i = 0; i < n; ++i)
+        slices.emplace_back(buffer.data() + offsets[i], 40);
+    std::shuffle(slices.begin(), slices.end(), std::mt19937_64{42});
+    ADS_set<std::string, N, std::allocator<std::string>, WyHash,
+            std::equal_to<>> set;
+    for (std::string_view slice : slices)
+        set.insert(std::string(slice));
+
+    size_t found = 0;
+    double copied = time_ms([&] {
+        for (std::string_view slice : slices)
+            found += set.count(std::string(slice));
+    });
+    double direct = time_ms([&] {
+        for (std::string_view slice : slices)
+            found += set.count(slice);
+    });
+    std::cout << "transparent n=" << n << " N=" << N << ": std::string "
+              << copied * 1e6 / n << " ns/op, string_view "
+              << direct * 1e6 / n << " ns/op (found " << found << ")\n";
+}
+
+int main(int argc, char **argv) {
+    std::string mode = argc > 1 ? argv[1] : "buckets";
+    if (mode == "lookup") {
+        for (size_t n : parse_sizes(argc, argv, {1000000, 100000000})) {
+            lookup_benchmark<size_t, 63>(n);
+            lookup_benchmark<std::string, 63>(n);
+        }
+        return 0;
+    }
+    if (mode == "transparent") {
+        for (size_t n : parse_sizes(argc, argv, {1000000}))
+            transparent_benchmark<63>(n);
+        return 0;
+    }
+    if (mode == "batch") {
+        for (size_t n : parse_sizes(argc, argv, {100000000}))
+            batch_benchmark<63>(n);
+        return 0;
+    }
+    if (mode == "coro") {
+#ifdef __cpp_impl_coroutine
+        for (size_t n : parse_sizes(argc, argv, {100000000}))
+            coro_benchmark<63>(n);
+#else
+        std::cerr << "coro needs a C++20 build\n";
+#endif
+        return 0;
+    }
+    if (mode == "bulk") {
+        for (size_t n : parse_sizes(argc, argv, {10000000, 100000000}))
+            bulk_benchmark<63>(n);
+        return 0;
+    }
+    if (mode == "actor") {
+        for (size_t n : parse_sizes(argc, argv, {1000000}))
+            actor_benchmark<63>(n);
+        return 0;
+    }
+    if (mode == "threads") {
+        for (size_t n : parse_sizes(argc, argv, {4000000}))
+            threads_benchmark<63>(n);
+        return 0;
+    }
+    if (mode == "reserve") {
+        for (size_t n : parse_sizes(argc, argv, {1000000})) {
+            reserve_benchmark<size_t, 63>(n);
+            reserve_benchmark<std::string, 63>(n);
+        }
+        return 0;
+    }
+    if (mode == "copy") {
+        for (size_t n : parse_sizes(argc, argv, {1000000, 10000000})) {
+            copy_benchmark<size_t, 63>(n);
+            copy_benchmark<std::string, 63>(n);
+        }
+        return 0;
+    }
+    if (mode == "hashers") {
+        for (size_t n : parse_sizes(argc, argv, {1000000, 10000000})) {
+            std::vector<size_t> ints(n);
+            std::iota(ints.begin(), ints.end(), size_t{0});
+            hashers_benchmark("sequential", ints);
+            // identity hashes leave the low 10 bits of the index unused
+            for (size_t i = 0; i < n; ++i)
+                ints[i] = i << 10;
+            hashers_benchmark("strided", ints);
+            std::mt19937_64 rng{7};
+            for (size_t &k : ints)
+                k = rng();
+            hashers_benchmark("random", ints);
+            std::vector<std::string> strings;
+            for (size_t i = 0; i < n; ++i)
+                strings.push_back(make_key<std::string>(i));
+            hashers_benchmark("string", strings);
+        }
+        return 0;
+    }
+    if (mode == "snapshot") {
+        for (size_t n : parse_sizes(argc, argv, {1000000, 10000000})) {
+            snapshot_benchmark<size_t, 63>(n);
+            snapshot_benchmark<std::string, 63>(n);
+        }
+        return 0;
+    }
+    if (mode == "split") {
+        for (size_t d : parse_sizes(argc, argv, {10, 14, 18, 22}))
+            split_benchmark<63>(d);
+        return 0;
+    }
+
+
     benchmark<int, 8>();
     benchmark<int, 16>();
     benchmark<int, 32>();